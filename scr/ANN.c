@@ -6,10 +6,19 @@
  * Last Modified: 11/12/2017
  * 
  * NOTES:
- *  Neural nodes output are determined by the sigmoid function,
- *   where the input of the sigmoid is given by a weightedSum.
+ *  Neural nodes output are determined by their layer's activation
+ *   function (sigmoid, tanh, relu, or leaky relu), where the input of
+ *   the activation is given by a weightedSum. The output layer is always
+ *   sigmoid, since its outputs in [0, 1] are decoded by translations.
+ *  Activations and their derivatives are applied to a whole layer at a
+ *   time, in loops simple enough for the compiler to vectorize. Each
+ *   derivative is computed from the activation's output rather than its
+ *   input, so backpropagation needs nothing but the layer's outputs.
  *  Details of forward running and backpropagation are provided
  *   within their respective functions.
+ *  Each layer's weights are one contiguous block, node after node, so
+ *   runForward(..) and BPandWeightUpdate(..) both stream through them
+ *   in memory order.
  * ***********************************************************************
  */
 
@@ -20,8 +29,11 @@ struct network {
 	int inputLen;
 	int layerCount;
 	int *nodeCounts;
+	int *activations;
 	double **outputs;
 	double ***weights;
+	double **deltas;
+	double *inputs;
 	struct translation *translations;
 } network;
 
@@ -29,12 +41,15 @@ struct network {
  * inputLen: length of input vector
  * layerCount: number of layers (excludes in, includes out)
  * nodeCounts: number of nodes in each layer
+ * activations: activation function of each layer, ACTIVATION_SIGMOID for the output layer
  * outputs: output values of each node from most recent runForward(..)
  * weights: weights of each node of each layer
+ * deltas: delta values of each node from most recent BPandWeightUpdate(..)
+ * inputs: translated input vector from most recent runForward(..) or BPandWeightUpdate(..)
  * translations: stores translation info between numerical and character output
  * 
  * 
- * length of nodeCounts = layerCount
+ * length of nodeCounts, activations = layerCount
  * 
  * length of outputs = layerCount
  * length of outputs[layer_i] = nodeCounts[layer_i]
@@ -44,106 +59,199 @@ struct network {
  * length of weights[layer_i][node_i] = nodeCounts[layer_i-1] + 1
  *    (+1 to include bias weight)
  *    except length(weights[layer_i==0][node_i]), which = inputLen + 1
+ * weights[layer_i][0] is the start of layer_i's block, and
+ *  weights[layer_i][node_i] = weights[layer_i][0] + node_i*length(weights[layer_i][0])
+ * 
+ * length of deltas, deltas[layer_i] = same as outputs
+ * length of inputs = inputLen
  * 
  * length of translations = nodeCounts[layerCount-1] (i.e. outputLen)
  */
 
+#define ACTIVATION_SIGMOID 0
+#define ACTIVATION_TANH 1
+#define ACTIVATION_RELU 2
+#define ACTIVATION_LEAKY_RELU 3
+#define ACTIVATION_COUNT 4
+#define LEAKY_RELU_SLOPE 0.01 // slope of leaky relu for negative sums
+
+char *activationNames[ACTIVATION_COUNT] = {"sigmoid", "tanh", "relu", "leaky"};
+
 double sigmoid(double sum) {
 	return 1.0/(1.0+exp(0.0-sum));
 }
 
-double sumDeltasNextLayer(int currentNode, double** weights, double *deltas, int count) {
-	double sum = 0.0;
-	for (int d_i=0; d_i<count; d_i++)
-		sum += weights[d_i][currentNode+1]*deltas[d_i];
-	return sum;
+// replaces a layer's weighted sums by their activation
+void activate(double *values, int count, int activation) {
+	switch (activation) {
+		case ACTIVATION_TANH:
+			for (int v_i=0; v_i<count; v_i++)
+				values[v_i] = tanh(values[v_i]);
+			break;
+		case ACTIVATION_RELU:
+			for (int v_i=0; v_i<count; v_i++)
+				values[v_i] = values[v_i] > 0.0 ? values[v_i] : 0.0;
+			break;
+		case ACTIVATION_LEAKY_RELU:
+			for (int v_i=0; v_i<count; v_i++)
+				values[v_i] = values[v_i] > 0.0 ? values[v_i] : LEAKY_RELU_SLOPE*values[v_i];
+			break;
+		default:
+			for (int v_i=0; v_i<count; v_i++)
+				values[v_i] = sigmoid(values[v_i]);
+	}
+}
+
+// multiplies values by the differential of activation, given the layer's outputs
+void scaleByDerivative(double *values, double *outputs, int count, int activation) {
+	switch (activation) {
+		case ACTIVATION_TANH:
+			for (int v_i=0; v_i<count; v_i++)
+				values[v_i] *= 1.0-outputs[v_i]*outputs[v_i];
+			break;
+		case ACTIVATION_RELU:
+			for (int v_i=0; v_i<count; v_i++)
+				values[v_i] = outputs[v_i] > 0.0 ? values[v_i] : 0.0;
+			break;
+		case ACTIVATION_LEAKY_RELU:
+			for (int v_i=0; v_i<count; v_i++)
+				values[v_i] *= outputs[v_i] > 0.0 ? 1.0 : LEAKY_RELU_SLOPE;
+			break;
+		default:
+			for (int v_i=0; v_i<count; v_i++)
+				values[v_i] *= outputs[v_i]*(1.0-outputs[v_i]);
+	}
 }
 
+// tile width (in weights) of BPandWeightUpdate(..), keeps a tile of deltas and inputs in L1 cache
+#define BP_TILE 512
 
 
+// converts the output layer's values to corresponding char values and stores them as vector in output
+void decodeOutput(struct network *network, double *values, char *output) {
+	// (sigmoid(weightedSum) rounds to exactly 1.0 for large sums, which belongs to the last entry)
+	for (int o_i=0; o_i<network->nodeCounts[network->layerCount-1]; o_i++) {
+		int t_i = (int)(network->translations[o_i].count*values[o_i]);
+		output[o_i] = network->translations[o_i].entries[t_i < network->translations[o_i].count ? t_i : network->translations[o_i].count-1];
+	}
+}
+
 void runForward(struct network *network, char *input, char *output) {
-	/* For each node in the network, 
-	 * network->outputs[l_i][n_i] first temporarilly stores the weightedSum
-	 * and then finally stores sigmoid(weightedSum)
+	// translate input once, rather than once per node of the first layer
+	for (int in_i=0; in_i<network->inputLen; in_i++)
+		network->inputs[in_i] = translateInput(input[in_i]);
+
+	/* For each node in the network, the weightedSum is the bias
+	 *  (weights[l_i][n_i][0]) plus the dot product of the node's remaining
+	 *  weights with the layer's input (for the first layer, the translated
+	 *  input vector, but all other layers use as input the output of the
+	 *  preceeding layer), and the node's output is the layer's activation of weightedSum
 	 */
 	for (int l_i=0; l_i<network->layerCount; l_i++) {
+		int inCount = l_i == 0 ? network->inputLen : network->nodeCounts[l_i-1];
+		double *in = l_i == 0 ? network->inputs : network->outputs[l_i-1];
 		for (int n_i=0; n_i<network->nodeCounts[l_i]; n_i++) {
-			for (int w_i=0; w_i<=(l_i==0?network->inputLen:network->nodeCounts[l_i-1]); w_i++) {
-				if (w_i == 0)
-					// resets node's weightedSum to bias value
-					network->outputs[l_i][n_i] = network->weights[l_i][n_i][w_i];
-				else
-					// add input multiplied by weight to running weightedSum 
-					// (for the first layer, input source is char *input parameter, but all other layers use as input the output of the preceeding layer)
-					network->outputs[l_i][n_i] += network->weights[l_i][n_i][w_i]*(l_i==0?translateInput(input[w_i-1]):network->outputs[l_i-1][w_i-1]);
+			double *w = network->weights[l_i][n_i] + 1;
+			double weightedSum = network->weights[l_i][n_i][0];
+			for (int w_i=0; w_i<inCount; w_i++)
+				weightedSum += w[w_i]*in[w_i];
+			network->outputs[l_i][n_i] = weightedSum;
+		}
+		activate(network->outputs[l_i], network->nodeCounts[l_i], network->activations[l_i]);
+	}
+	decodeOutput(network, network->outputs[network->layerCount-1], output);
+}
+
+/* runs rowCount rows forward together, input[r_i] and output[r_i] are the vectors of row r_i
+ * each node's weights are read once for the whole batch, rather than once per row, and stay in
+ *  cache while every row's weightedSum is taken
+ * network->inputs and network->outputs[l_i] must have room for rowCount rows, which are stored
+ *  one after another, e.g. row r_i's outputs of layer l_i start at outputs[l_i] + r_i*nodeCounts[l_i]
+ */
+void runForwardBatch(struct network *network, int rowCount, char **input, char **output) {
+	for (int r_i=0; r_i<rowCount; r_i++)
+		for (int in_i=0; in_i<network->inputLen; in_i++)
+			network->inputs[r_i*network->inputLen + in_i] = translateInput(input[r_i][in_i]);
+
+	for (int l_i=0; l_i<network->layerCount; l_i++) {
+		int inCount = l_i == 0 ? network->inputLen : network->nodeCounts[l_i-1];
+		double *in = l_i == 0 ? network->inputs : network->outputs[l_i-1];
+		int nodeCount = network->nodeCounts[l_i];
+		for (int n_i=0; n_i<nodeCount; n_i++) {
+			double *w = network->weights[l_i][n_i] + 1;
+			for (int r_i=0; r_i<rowCount; r_i++) {
+				double *rowIn = in + r_i*inCount;
+				double weightedSum = network->weights[l_i][n_i][0];
+				for (int w_i=0; w_i<inCount; w_i++)
+					weightedSum += w[w_i]*rowIn[w_i];
+				network->outputs[l_i][r_i*nodeCount + n_i] = weightedSum;
 			}
-			// store sigmoid(weightedSum) as node's output
-			network->outputs[l_i][n_i] = sigmoid(network->outputs[l_i][n_i]);
 		}
+		activate(network->outputs[l_i], rowCount*nodeCount, network->activations[l_i]);
 	}
-	// convert output of outputLayer to corresponding char values and store as vector in char *output parameter
-	for (int o_i=0; o_i<network->nodeCounts[network->layerCount-1]; o_i++)
-		output[o_i] = network->translations[o_i].entries[(int)(network->translations[o_i].count*network->outputs[network->layerCount-1][o_i])];
+	int outputLen = network->nodeCounts[network->layerCount-1];
+	for (int r_i=0; r_i<rowCount; r_i++)
+		decodeOutput(network, network->outputs[network->layerCount-1] + r_i*outputLen, output[r_i]);
 }
 
 
 int BPandWeightUpdate(struct network *network, char *input, char *desiredOutput, double learningRate) {
-  // malloc delta matrix (matrix is "ragged", secondary dimension are of different lengths)
-  double **delta = malloc(sizeof(double*)*(network->layerCount));
-  if (delta == NULL) {
-    fprintf(stderr, "failed to allocate memory to delta\n");
-    return -1;
-  }
-  /* calculate delta values for all nodes, working backward through layers
-	 * for all nodes, delta is determined by differential of sigmoid function,
-	 *  i.e. nodeOutput * (1 - Output), and by then multipling by...
-	 *    for last (output layer), * (desiredOutput - nodeOutput)
-	 *    for all other nodes, * sumForAllNodesInNextLayer(deltaOfNodeInNextLayer*weightConnectingThisNodeToNodeInNextLayer)
-	 */
-  for (int l_i=network->layerCount-1; l_i>=0; l_i--) {
-    if ((delta[l_i] = malloc(sizeof(double)*(network->nodeCounts[l_i]))) == NULL) {
-      fprintf(stderr, "failed to allocate memory to delta[%d]\n", l_i);
-      return -1;
-    }
-    for (int n_i=0; n_i<network->nodeCounts[l_i]; n_i++) {
-      double factorOfDelta;
-      // for output layer
-      if (l_i == network->layerCount-1) {
-        if ((factorOfDelta = translateOutput(desiredOutput[n_i], network->translations[n_i])) < 0) {
-          return -1; // error
-        }
-        else {
-          factorOfDelta -= network->outputs[l_i][n_i];
-        }
-      }
-      // for hidden layers
-      else {
-        factorOfDelta = sumDeltasNextLayer(n_i, network->weights[l_i+1], delta[l_i+1], network->nodeCounts[l_i+1]);
-      }
-      delta[l_i][n_i] = network->outputs[l_i][n_i]*(1.0-network->outputs[l_i][n_i])*factorOfDelta;
-    }
-  }
-  /* update weights
-	 * for all weights, the change in the weight is determined by
-	 *  the learningRate
-	 *  the output of the node which is at the front of the weight
-	 *  the delta value of the node which is at the receiving end of the weight
-	 */
-  for (int l_i=network->layerCount-1; l_i>=0; l_i--) {
-    for (int n_i=0; n_i<network->nodeCounts[l_i]; n_i++) {
-      for (int w_i=0; w_i<=((l_i == 0) ? network->inputLen : network->nodeCounts[l_i-1]); w_i++) {
-        // update weight
-        double in = w_i == 0? 1 : (l_i == 0? translateInput(input[w_i-1]) : network->outputs[l_i-1][w_i-1]);
-        network->weights[l_i][n_i][w_i] += learningRate*in*delta[l_i][n_i];
-      }
-    }
-		free(delta[l_i]);
-  }
-  free(delta);
-  return 0;
-}
+	int outLayer = network->layerCount-1;
+	for (int in_i=0; in_i<network->inputLen; in_i++)
+		network->inputs[in_i] = translateInput(input[in_i]);
 
+	/* delta values of the output layer are determined by differential of its activation function,
+	 *  i.e. nodeOutput * (1 - Output) for sigmoid, multiplied by (desiredOutput - nodeOutput)
+	 */
+	for (int n_i=0; n_i<network->nodeCounts[outLayer]; n_i++) {
+		double desired;
+		if ((desired = translateOutput(desiredOutput[n_i], network->translations[n_i])) < 0)
+			return -1; // error
+		network->deltas[outLayer][n_i] = desired-network->outputs[outLayer][n_i];
+	}
+	scaleByDerivative(network->deltas[outLayer], network->outputs[outLayer], network->nodeCounts[outLayer], network->activations[outLayer]);
 
+	/* working backward through layers, one pass over each layer's weights both
+	 *  sums the deltas of the layer below, i.e. for each node of the layer below,
+	 *   sumForAllNodesInThisLayer(deltaOfNodeInThisLayer*weightConnectingThem)
+	 *   (using each weight before it is updated)
+	 *  and updates the weights, each changing by
+	 *   learningRate * output of the node at the front of the weight * delta of the node at the receiving end
+	 * the weights are walked in tiles of BP_TILE columns, so the tile of sums and of
+	 *  inputs stays in cache while every node's row passes through it
+	 * the sums are finally multiplied by the activation differential of the layer below
+	 */
+	for (int l_i=outLayer; l_i>=0; l_i--) {
+		int inCount = l_i == 0 ? network->inputLen : network->nodeCounts[l_i-1];
+		double *in = l_i == 0 ? network->inputs : network->outputs[l_i-1];
+		double *delta = network->deltas[l_i];
+		double *sums = l_i == 0 ? NULL : network->deltas[l_i-1];
+		if (sums)
+			for (int w_i=0; w_i<inCount; w_i++)
+				sums[w_i] = 0.0;
 
+		// bias weights
+		for (int n_i=0; n_i<network->nodeCounts[l_i]; n_i++)
+			network->weights[l_i][n_i][0] += learningRate*delta[n_i];
 
+		for (int t_i=0; t_i<inCount; t_i+=BP_TILE) {
+			int tileEnd = t_i+BP_TILE < inCount ? t_i+BP_TILE : inCount;
+			for (int n_i=0; n_i<network->nodeCounts[l_i]; n_i++) {
+				double *w = network->weights[l_i][n_i] + 1;
+				double step = learningRate*delta[n_i];
+				if (sums)
+					for (int w_i=t_i; w_i<tileEnd; w_i++) {
+						sums[w_i] += w[w_i]*delta[n_i];
+						w[w_i] += step*in[w_i];
+					}
+				else
+					for (int w_i=t_i; w_i<tileEnd; w_i++)
+						w[w_i] += step*in[w_i];
+			}
+		}
 
+		if (sums)
+			scaleByDerivative(sums, in, inCount, network->activations[l_i-1]);
+	}
+	return 0;
+}
@@ -13,12 +13,22 @@
  *   recent accuracies, and comparing the current accuracy
  *   against the oldest. If the two are sufficiently similar,
  *   it's time to stop.
+ *  If an auditInterval is given, a struct scheduler (Scheduler.c)
+ *   decides which rows are run forward each epoch; rows it skips were
+ *   confidently correct when last visited and are counted as correct.
+ *   Every auditInterval epochs all rows are visited.
+ *  If a struct loader (Loader.c) is given, the IO data file is still
+ *   being loaded, and the first epoch trains on rows as they are loaded.
+ *   view's rows are then the leading rows of the dataset, however many
+ *   turn out to be training rows.
  * ***********************************************************************
  */
 
 
 #include <time.h>
 #include "ANN.c"
+#include "Scheduler.c"
+#include "Loader.c"
 
 
 void printWeights(struct network network, FILE *outputFile) {
@@ -35,57 +45,185 @@ void printWeights(struct network network, FILE *outputFile) {
 }
 
 
-int buildNetwork(struct network *network, int inputLen, int layerCount, int nodeCounts[], struct translation translations[]) {
+/* allocates the buffers a network writes as each row is run through it (outputs, deltas, inputs),
+ * zeroed by the calling thread, so on a NUMA machine their pages are on that thread's node
+ * on failure, whatever was allocated is left for freeRowBuffers(..)
+ */
+int allocateRowBuffers(struct network *network) {
+  network->deltas = NULL;
+  network->inputs = NULL;
+  if ((network->outputs = calloc(network->layerCount, sizeof(double *))) == NULL) {
+    fprintf(stderr, "failed to allocate memory to struct network network->outputs\n");
+    return -1;
+  }
+  if ((network->deltas = calloc(network->layerCount, sizeof(double *))) == NULL) {
+    fprintf(stderr, "failed to allocate memory to struct network network->deltas\n");
+    return -1;
+  }
+  if ((network->inputs = calloc(network->inputLen, sizeof(double))) == NULL) {
+    fprintf(stderr, "failed to allocate memory to struct network network->inputs\n");
+    return -1;
+  }
+  for (int l_i=0; l_i<network->layerCount; l_i++) {
+    if ((network->outputs[l_i] = calloc(network->nodeCounts[l_i], sizeof(double))) == NULL) {
+      fprintf(stderr, "failed to allocate memory to struct network network->outputs[%d]\n", l_i);
+      return -1;
+    }
+    if ((network->deltas[l_i] = calloc(network->nodeCounts[l_i], sizeof(double))) == NULL) {
+      fprintf(stderr, "failed to allocate memory to struct network network->deltas[%d]\n", l_i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void freeRowBuffers(struct network *network) {
+  for (int l_i=0; l_i<network->layerCount; l_i++) {
+    if (network->outputs)
+      free(network->outputs[l_i]);
+    if (network->deltas)
+      free(network->deltas[l_i]);
+  }
+  free(network->outputs);
+  free(network->deltas);
+  free(network->inputs);
+  network->outputs = NULL;
+  network->deltas = NULL;
+  network->inputs = NULL;
+}
+
+
+// frees a network, also one which allocateNetwork(..) only partly allocated
+void cleanupNetwork(struct network *network) {
+  // free weights
+  for (int l_i=0; network->weights && l_i<network->layerCount; l_i++)
+    if (network->weights[l_i]) {
+      freeLarge(network->weights[l_i][0]);
+      free(network->weights[l_i]);
+    }
+  free(network->weights);
+  network->weights = NULL;
+
+  freeRowBuffers(network);
+}
+
+
+/* allocates a network of the given topology and activations, weights are left uninitialized
+ * on failure, whatever was allocated is freed again
+ */
+int allocateNetwork(struct network *network, int inputLen, int layerCount, int nodeCounts[], int activations[], struct translation translations[]) {
   // set basic info
   network->inputLen = inputLen;
   network->layerCount = layerCount;
   network->nodeCounts = nodeCounts;
+  network->activations = activations;
   network->translations = translations;
 
   // build layers
-  if ((network->outputs = malloc(sizeof(double **)*layerCount)) == NULL) {
-    fprintf(stderr, "failed to allocate memory to struct network network->outputs\n");
+  network->outputs = NULL;
+  network->deltas = NULL;
+  network->inputs = NULL;
+  if ((network->weights = calloc(layerCount, sizeof(double **))) == NULL) {
+    fprintf(stderr, "failed to allocate memory to struct network network->weights\n");
     return -1;
   }
-  if ((network->weights = malloc(sizeof(double **)*layerCount)) == NULL) {
-    fprintf(stderr, "failed to allocate memory to struct network network->weights\n");
+  for (int l_i=0; l_i<layerCount; l_i++)
+    if ((network->weights[l_i] = calloc(nodeCounts[l_i], sizeof(double *))) == NULL) {
+      fprintf(stderr, "failed to allocate memory to struct network network->weights[%d]\n", l_i);
+      cleanupNetwork(network);
+      return -1;
+    }
+  if (allocateRowBuffers(network) < 0) {
+    cleanupNetwork(network);
     return -1;
   }
-  fprintf(stdout, "Network Topology: %d layers\n", network->layerCount);
-  fprintf(stdout, "Length of input vector: %d\n", network->inputLen);
 
-  // build nodes
+  // build weights, one contiguous block per layer, on huge pages where possible (see Memory.c)
   for (int l_i=0; l_i<layerCount; l_i++) {
-    if ((network->outputs[l_i] = malloc(sizeof(double *)*nodeCounts[l_i])) == NULL) {
-      fprintf(stderr, "failed to allocate memory to struct network network->outputs[%d]\n", l_i);
-      return -1;
-    }
-    if ((network->weights[l_i] = malloc(sizeof(double *)*nodeCounts[l_i])) == NULL) {
+    int rowLen = l_i == 0 ? inputLen+1 : nodeCounts[l_i-1]+1;
+    if ((network->weights[l_i][0] = allocLarge(sizeof(double)*rowLen*nodeCounts[l_i], NODE_LOCAL)) == NULL) {
       fprintf(stderr, "failed to allocate memory to struct network network->weights[%d]\n", l_i);
+      cleanupNetwork(network);
       return -1;
     }
+    for (int n_i=1; n_i<nodeCounts[l_i]; n_i++)
+      network->weights[l_i][n_i] = network->weights[l_i][0] + n_i*rowLen;
+  }
+
+  return 0;
+}
+
+
+/* moves a network's weights to a NUMA node (see Memory.c), and reallocates its row buffers on the calling thread,
+ * which should be the thread, pinned to node, that will train or run the network
+ */
+int placeNetwork(struct network *network, int node) {
+  for (int l_i=0; l_i<network->layerCount; l_i++)
+    moveLarge(network->weights[l_i][0], node);
+  freeRowBuffers(network);
+  return allocateRowBuffers(network);
+}
+
+
+void printTopology(struct network network) {
+  fprintf(stdout, "Network Topology: %d layers\n", network.layerCount);
+  fprintf(stdout, "Length of input vector: %d\n", network.inputLen);
+  for (int l_i=0; l_i<network.layerCount; l_i++) {
     if (l_i==0)
-			fprintf(stdout, "Node counts: %d", network->nodeCounts[l_i]);
+			fprintf(stdout, "Node counts: %d", network.nodeCounts[l_i]);
 		else
-			fprintf(stdout, ", %d", network->nodeCounts[l_i]);
-		if (l_i == layerCount-1)
-			fprintf(stdout, "\nLength of output vector: %d\n", network->nodeCounts[l_i]);
+			fprintf(stdout, ", %d", network.nodeCounts[l_i]);
 	}
+	fprintf(stdout, "\nActivations: ");
+	for (int l_i=0; l_i<network.layerCount; l_i++)
+		fprintf(stdout, "%s%s", l_i ? ", " : "", activationNames[network.activations[l_i]]);
+	fprintf(stdout, "\nLength of output vector: %d\n", network.nodeCounts[network.layerCount-1]);
+}
 
-  // build weights
-  for (int l_i=0; l_i<layerCount; l_i++)
-    for (int n_i=0; n_i<nodeCounts[l_i]; n_i++)
-      if ((network->weights[l_i][n_i] = malloc(sizeof(double)*(l_i == 0 ? inputLen+1 : nodeCounts[l_i-1]+1))) == NULL) {
-        fprintf(stderr, "failed to allocate memory to struct network network->weights[%d][%d]\n", l_i, n_i);
-        return -1;
-      }
+
+// a random value from the standard normal distribution, by the Box-Muller transform
+double randomNormal(void) {
+  double u1 = (rand() + 1.0) / ((double)RAND_MAX + 2.0); // in (0, 1), so log(u1) is finite
+  double u2 = (double)rand() / (double)RAND_MAX;
+  return sqrt(-2.0*log(u1)) * cos(2.0*M_PI*u2);
+}
+
+/* sets a node's weights to random values:
+ *  sigmoid layers, uniform in [-1, 1], bias included
+ *  He initialization for relu and leaky relu layers, normal with variance 2/fanIn, bias 0
+ *  Xavier initialization for tanh layers, uniform in [-limit, limit], limit = sqrt(6/(fanIn+fanOut)), bias 0
+ * the scaled schemes keep sums from saturating or vanishing as they pass through deep networks
+ */
+void randomizeNode(struct network *network, int l_i, int n_i) {
+  int fanIn = l_i == 0 ? network->inputLen : network->nodeCounts[l_i-1];
+  int fanOut = network->nodeCounts[l_i];
+  if (network->activations[l_i] == ACTIVATION_SIGMOID) {
+    for (int w_i=0; w_i<=fanIn; w_i++)
+      network->weights[l_i][n_i][w_i] = (((double)rand() / (double)RAND_MAX) * 2) - 1;
+    return;
+  }
+  int he = network->activations[l_i] == ACTIVATION_RELU || network->activations[l_i] == ACTIVATION_LEAKY_RELU;
+  double scale = he ? sqrt(2.0/fanIn) : sqrt(6.0/(fanIn+fanOut));
+  network->weights[l_i][n_i][0] = 0.0;
+  for (int w_i=1; w_i<=fanIn; w_i++)
+    network->weights[l_i][n_i][w_i] = scale * (he ? randomNormal() : (((double)rand() / (double)RAND_MAX) * 2) - 1);
+}
+
+void randomizeWeights(struct network *network) {
+  for (int l_i=0; l_i<network->layerCount; l_i++)
+    for (int n_i=0; n_i<network->nodeCounts[l_i]; n_i++)
+      randomizeNode(network, l_i, n_i);
+}
+
+
+int buildNetwork(struct network *network, int inputLen, int layerCount, int nodeCounts[], int activations[], struct translation translations[]) {
+  if (allocateNetwork(network, inputLen, layerCount, nodeCounts, activations, translations) < 0)
+    return -1;
+  printTopology(*network);
 
   // randomize weights
   srand(time(NULL));
-  for (int l_i=0; l_i<layerCount; l_i++)
-    for (int n_i=0; n_i<nodeCounts[l_i]; n_i++)
-      for (int w_i=0; w_i<=((l_i == 0) ? inputLen : nodeCounts[l_i-1]); w_i++)
-        network->weights[l_i][n_i][w_i] = (((double)rand() / (double)RAND_MAX) * 2) - 1;
+  randomizeWeights(network);
 
   return 0;
 }
@@ -96,84 +234,123 @@ int convergence(int accuracy[], int convergenceRange, int epoch) {
 }
 
 
-int train(struct network network, struct IOData io[], int trainingIOCount, int maxEpoch, double learningRate, char *dumpFileName, int precision, int convRange) {
+// runs the v_i'th row of view forward, returns whether the network's output matches the row's output
+int evaluateRow(struct network *network, struct datasetView view, int v_i, char *input, char *desired) {
+  char output[network->nodeCounts[network->layerCount-1]]; // stores ANN output
+  getViewRow(view, v_i, input, desired);
+  runForward(network, input, output);
+  int correct = 1; // treat as boolean
+  for (int r_i=0; r_i<network->nodeCounts[network->layerCount-1]; r_i++)
+    if (desired[r_i] != output[r_i])
+      correct = 0;
+  return correct;
+}
+
+// one pass over view, backpropagating incorrect rows, returns number of correct rows
+int trainEpoch(struct network *network, struct datasetView view, double learningRate) {
+  int accuracy = 0;
+  char input[network->inputLen]; // stores row's input
+  char desired[network->nodeCounts[network->layerCount-1]]; // stores row's output
+  for (int io_i=0; io_i < view.count; io_i++) {
+    if (evaluateRow(network, view, io_i, input, desired))
+      accuracy++;
+    else if (BPandWeightUpdate(network, input, desired, learningRate) < 0)
+      return -1; // error
+  }
+  return accuracy;
+}
+
+
+// when loader is given, view.count is ignored and found as loading finishes
+int train(struct network network, struct datasetView view, struct loader *loader, int maxEpoch, double learningRate, char *dumpFileName, int precision, int convRange, int auditInterval) {
   int epoch = 0;
+	int trainingIOCount = loader ? 0 : view.count; // while loading, the rows known to be training rows
 	int convergenceRange = convRange;
 	int accuracy[convergenceRange];
-  char output[network.nodeCounts[network.layerCount-1]]; // stores ANN output
+	int audit = 1; // treat as boolean, whether the most recent epoch visited every row
+	char input[network.inputLen]; // stores row's input
+	char desired[network.nodeCounts[network.layerCount-1]]; // stores row's output
 	FILE *dumpFile = NULL;
 	if ((dumpFileName) && ((dumpFile = fopen(dumpFileName, "w+")) == NULL)) {
 		fprintf(stderr,"could not open file \"%s\"\n", dumpFileName);
 		return -1;
 	}
+	struct scheduler scheduler;
+	if (auditInterval && buildScheduler(&scheduler, loader ? loader->maxRows : trainingIOCount, auditInterval) < 0)
+		return -1;
 	
   do {
     accuracy[epoch%convergenceRange] = 0;
+		audit = !auditInterval || isAuditEpoch(&scheduler, epoch);
+		int visited = 0;
 
-    for (int io_i=0; io_i < trainingIOCount; io_i++) {
-      // run network forward
-      runForward(&network, io[io_i].input, output);
+    // while loading, each time the known training rows run out, wait for more until loading is done
+    for (int io_i=0; io_i < trainingIOCount || (loader && (trainingIOCount = awaitTrainingRows(loader, io_i, network.translations)) > io_i); io_i++) {
+			// skipped rows were confidently correct when last visited
+			if (!audit && !isRowDue(&scheduler, io_i, epoch)) {
+				accuracy[epoch%convergenceRange]++;
+				continue;
+			}
+			visited++;
 
-      // evaluate result
-      int correct = 1; // treat as boolean
-      for (int r_i=0; r_i<network.nodeCounts[network.layerCount-1]; r_i++)
-        if (io[io_i].output[r_i] != output[r_i])
-          correct = 0;
+      // run network forward and evaluate result
+      int correct = evaluateRow(&network, view, io_i, input, desired);
+			if (auditInterval)
+				updateRow(&scheduler, io_i, epoch, outputMargin(&network, desired), correct);
 
       // deal with result
       if (correct)
         accuracy[epoch%convergenceRange]++;
       else {
-        if (BPandWeightUpdate(&network, io[io_i].input, io[io_i].output, learningRate) < 0)
+        if (BPandWeightUpdate(&network, input, desired, learningRate) < 0)
           return -1; // error
 				if (dumpFile)
 					printWeights(network, dumpFile);
       }
     }
-		fprintf(stdout, "Epoch %3d accuracy: %4d / %d = %.2f%%\n", epoch, accuracy[epoch%convergenceRange], trainingIOCount, 100*accuracy[epoch%convergenceRange]/(double)trainingIOCount);
+		if (loader) {
+			// loading is done, every training row has been seen
+			if (trainingIOCount < 0)
+				return -1; // error
+			if (trainingIOCount == 0) {
+				fprintf(stdout, "No rows to train on\n");
+				break;
+			}
+			loader = NULL;
+		}
+		if (auditInterval)
+			finishEpoch(&scheduler, epoch);
+		if (audit)
+			fprintf(stdout, "Epoch %3d accuracy: %4d / %d = %.2f%%\n", epoch, accuracy[epoch%convergenceRange], trainingIOCount, 100*accuracy[epoch%convergenceRange]/(double)trainingIOCount);
+		else
+			fprintf(stdout, "Epoch %3d accuracy: %4d / %d = %.2f%% (estimated, %d rows visited)\n", epoch, accuracy[epoch%convergenceRange], trainingIOCount, 100*accuracy[epoch%convergenceRange]/(double)trainingIOCount, visited);
   } while ((++epoch < maxEpoch) && 100*precision*convergence(accuracy, convergenceRange, epoch)/trainingIOCount);
 	
+	if (auditInterval) {
+		// final audit, so the last reported training accuracy is measured rather than estimated
+		if (!audit) {
+			int correctCount = 0;
+			for (int io_i=0; io_i < trainingIOCount; io_i++)
+				correctCount += evaluateRow(&network, view, io_i, input, desired);
+			fprintf(stdout, "Audit accuracy: %4d / %d = %.2f%%\n", correctCount, trainingIOCount, 100*correctCount/(double)trainingIOCount);
+		}
+		cleanupScheduler(&scheduler);
+	}
 	if (dumpFile)
 		fclose(dumpFile);
   return 0;
 }
 
-int trial(struct network network, struct IOData io[], int trialIOCount) {
+int trial(struct network network, struct datasetView view) {
   int accuracy = 0;
-  char output[network.nodeCounts[network.layerCount-1]]; // stores ANN output
+	int trialIOCount = view.count;
+	char input[network.inputLen]; // stores row's input
+	char desired[network.nodeCounts[network.layerCount-1]]; // stores row's output
 	
-	for (int io_i=0; io_i < trialIOCount; io_i++) {
-		// run network forward
-		runForward(&network, io[io_i].input, output);
-
-		// evaluate result
-		int correct = 1; // treat as boolean
-		for (int r_i=0; r_i<network.nodeCounts[network.layerCount-1]; r_i++)
-			if (io[io_i].output[r_i] != output[r_i])
-				correct = 0;
-
-		// deal with result
-		if (correct)
+	for (int io_i=0; io_i < trialIOCount; io_i++)
+		// run network forward and evaluate result
+		if (evaluateRow(&network, view, io_i, input, desired))
 			accuracy++;
-	}
 	fprintf(stdout, "Trial accuracy: %d / %d = %.2f%%\n", accuracy, trialIOCount, 100*accuracy/(double)trialIOCount);
   return 0;
 }
-
-
-void cleanupNetwork(struct network *network) {
-  // free weights
-  for (int l_i=0; l_i<network->layerCount; l_i++)
-    for (int n_i=0; n_i<network->nodeCounts[l_i]; n_i++)
-      free(network->weights[l_i][n_i]);
-
-  // free nodes
-  for (int l_i=0; l_i<network->layerCount; l_i++) {
-    free(network->outputs[l_i]);
-    free(network->weights[l_i]);
-  }
-
-  // free layers
-  free(network->outputs);
-  free(network->weights);
-}
@@ -0,0 +1,174 @@
+/* ***********************************************************************
+ * Program: Autotune.c
+ * Description: Benchmarks candidate topologies on a subsample of the
+ *  training data and recommends one for a given accuracy floor.
+ * Author: agent
+ * Last Modified: 10/18/2026
+ *
+ * NOTES:
+ *  struct network is defined in ANN.c, trainEpoch(..) in ANNManager.c,
+ *   avgBetween(..) in parseArgs.c
+ *  Candidates have 1 to AUTOTUNE_MAX_LAYERS layers. The first layer of a
+ *   multi-layer candidate has inputLen scaled by one of autotuneScales
+ *   nodes, and the layers between it and the output layer are filled in
+ *   by avgBetween(..), just like the default topology. Hidden layers all
+ *   use the activation function chosen with -a (the first, if several).
+ *  Every candidate gets an equal share of the time budget to train on the
+ *   tuning rows, so slower candidates get fewer epochs. Its throughput
+ *   (training rows per second) and its accuracy on the held out
+ *   validation rows are then measured.
+ *  A candidate is in the Pareto set if no other candidate is at least as
+ *   fast and at least as accurate, and better at one of them. The
+ *   recommendation is the fastest candidate at or above the accuracy
+ *   floor, or the most accurate candidate if none reach it.
+ * ***********************************************************************
+ */
+
+
+#define AUTOTUNE_MAX_LAYERS 4
+#define AUTOTUNE_ROWS 2000 // at most this many training rows are subsampled
+#define AUTOTUNE_VALIDATION 5 // every 5th subsampled row is held out for validation
+
+double autotuneScales[] = {0.5, 1.0, 2.0};
+
+struct candidate {
+	int layerCount;
+	int nodeCounts[AUTOTUNE_MAX_LAYERS];
+	int activations[AUTOTUNE_MAX_LAYERS];
+	int epochs;
+	double rowsPerSecond;
+	double accuracy;
+	int pareto;
+} candidate;
+
+
+// seconds on clock, e.g. CLOCK_MONOTONIC for wall time or CLOCK_THREAD_CPUTIME_ID for the thread's CPU time
+double clockSeconds(clockid_t clock) {
+	struct timespec t;
+	clock_gettime(clock, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+// accuracy of network on view, as a percentage
+double viewAccuracy(struct network *network, struct datasetView view) {
+	char input[network->inputLen];
+	char desired[network->nodeCounts[network->layerCount-1]];
+	int correct = 0;
+	for (int v_i=0; v_i<view.count; v_i++)
+		correct += evaluateRow(network, view, v_i, input, desired);
+	return view.count ? 100.0*correct/view.count : 0.0;
+}
+
+// fills candidates, returns number of candidates
+int buildCandidates(struct candidate candidates[], int inputLen, int outputLen, int hiddenActivation) {
+	int count = 0;
+	candidates[count].layerCount = 1;
+	candidates[count].activations[0] = ACTIVATION_SIGMOID;
+	candidates[count++].nodeCounts[0] = outputLen;
+	for (int l_i=2; l_i<=AUTOTUNE_MAX_LAYERS; l_i++)
+		for (int s_i=0; s_i<(int)(sizeof(autotuneScales)/sizeof(double)); s_i++) {
+			struct candidate *c = &candidates[count++];
+			c->layerCount = l_i;
+			c->nodeCounts[0] = (int)(inputLen*autotuneScales[s_i]) > 0 ? (int)(inputLen*autotuneScales[s_i]) : 1;
+			c->nodeCounts[l_i-1] = outputLen;
+			avgBetween(c->nodeCounts, 0, l_i-1);
+			for (int a_i=0; a_i<l_i-1; a_i++)
+				c->activations[a_i] = hiddenActivation;
+			c->activations[l_i-1] = ACTIVATION_SIGMOID;
+		}
+	return count;
+}
+
+// trains and measures one candidate for timeSlice seconds (at least one epoch)
+int benchmarkCandidate(struct candidate *c, int inputLen, struct translation translations[], struct datasetView tuneView, struct datasetView validView, double timeSlice, int maxEpoch, double learningRate) {
+	struct network network;
+	if (allocateNetwork(&network, inputLen, c->layerCount, c->nodeCounts, c->activations, translations) < 0)
+		return -1;
+	randomizeWeights(&network);
+
+	double trainTime = 0.0;
+	c->epochs = 0;
+	while (c->epochs < maxEpoch && (c->epochs == 0 || trainTime < timeSlice)) {
+		double start = clockSeconds(CLOCK_MONOTONIC);
+		if (trainEpoch(&network, tuneView, learningRate) < 0)
+			return -1;
+		trainTime += clockSeconds(CLOCK_MONOTONIC) - start;
+		c->epochs++;
+	}
+	c->rowsPerSecond = trainTime > 0 ? (double)c->epochs*tuneView.count/trainTime : 0.0;
+	c->accuracy = viewAccuracy(&network, validView);
+
+	cleanupNetwork(&network);
+	return 0;
+}
+
+/* benchmarks candidate topologies on a subsample of view for a total of budget seconds,
+ * prints each candidate (marking the Pareto set) and a recommended command line
+ */
+int autotune(struct dataset *data, struct datasetView view, struct translation translations[], int hiddenActivation, double budget, double accuracyFloor, int maxEpoch, double learningRate) {
+	// subsample view evenly, holding out every AUTOTUNE_VALIDATION'th row for validation
+	int sampleCount = view.count < AUTOTUNE_ROWS ? view.count : AUTOTUNE_ROWS;
+	struct datasetView tuneView = {data, 0, 0, NULL}, validView = {data, 0, 0, NULL};
+	if ((tuneView.rows = malloc(sizeof(int)*sampleCount)) == NULL || (validView.rows = malloc(sizeof(int)*sampleCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to autotune views\n");
+		return -1;
+	}
+	for (int s_i=0; s_i<sampleCount; s_i++) {
+		int row = viewRow(view, (int)((long)s_i*view.count/sampleCount));
+		if (s_i % AUTOTUNE_VALIDATION == AUTOTUNE_VALIDATION-1)
+			validView.rows[validView.count++] = row;
+		else
+			tuneView.rows[tuneView.count++] = row;
+	}
+
+	struct candidate candidates[1 + (AUTOTUNE_MAX_LAYERS-1)*sizeof(autotuneScales)/sizeof(double)];
+	int candidateCount = buildCandidates(candidates, data->inputLen, data->outputLen, hiddenActivation);
+	fprintf(stdout, "Autotuning %d topologies on %d rows (%d validation) for %.1fs\n", candidateCount, tuneView.count, validView.count, budget);
+
+	srand(time(NULL));
+	for (int c_i=0; c_i<candidateCount; c_i++)
+		if (benchmarkCandidate(&candidates[c_i], data->inputLen, translations, tuneView, validView, budget/candidateCount, maxEpoch, learningRate) < 0)
+			return -1;
+
+	// Pareto set, over throughput and accuracy
+	for (int c_i=0; c_i<candidateCount; c_i++) {
+		candidates[c_i].pareto = 1;
+		for (int o_i=0; o_i<candidateCount; o_i++)
+			if (candidates[o_i].rowsPerSecond >= candidates[c_i].rowsPerSecond && candidates[o_i].accuracy >= candidates[c_i].accuracy
+					&& (candidates[o_i].rowsPerSecond > candidates[c_i].rowsPerSecond || candidates[o_i].accuracy > candidates[c_i].accuracy))
+				candidates[c_i].pareto = 0;
+	}
+
+	// recommend fastest candidate at or above floor, else most accurate
+	int best = -1;
+	for (int c_i=0; c_i<candidateCount; c_i++)
+		if (candidates[c_i].accuracy >= accuracyFloor && (best < 0 || candidates[c_i].rowsPerSecond > candidates[best].rowsPerSecond))
+			best = c_i;
+	if (best < 0) {
+		best = 0;
+		for (int c_i=1; c_i<candidateCount; c_i++)
+			if (candidates[c_i].accuracy > candidates[best].accuracy)
+				best = c_i;
+		fprintf(stdout, "No topology reached the accuracy floor of %.2f%%\n", accuracyFloor);
+	}
+
+	fprintf(stdout, "\n  %-22s %6s %12s %9s\n", "topology", "epochs", "rows/sec", "accuracy");
+	for (int c_i=0; c_i<candidateCount; c_i++) {
+		char topology[64];
+		int len = 0;
+		for (int l_i=0; l_i<candidates[c_i].layerCount; l_i++)
+			len += sprintf(topology+len, "%s%d", l_i ? " " : "", candidates[c_i].nodeCounts[l_i]);
+		fprintf(stdout, "%c %-22s %6d %12.0f %8.2f%%%s\n", c_i == best ? '*' : ' ', topology, candidates[c_i].epochs, candidates[c_i].rowsPerSecond, candidates[c_i].accuracy, candidates[c_i].pareto ? "  pareto" : "");
+	}
+
+	fprintf(stdout, "\nRecommended: -l %d -n", candidates[best].layerCount);
+	for (int l_i=0; l_i<candidates[best].layerCount; l_i++)
+		fprintf(stdout, " %d", candidates[best].nodeCounts[l_i]);
+	if (candidates[best].layerCount > 1 && hiddenActivation != ACTIVATION_SIGMOID)
+		fprintf(stdout, " -a %s", activationNames[hiddenActivation]);
+	fprintf(stdout, "\n");
+
+	cleanupView(&tuneView);
+	cleanupView(&validView);
+	return 0;
+}
@@ -0,0 +1,262 @@
+/* ***********************************************************************
+ * Program: Checkpoint.c
+ * Description: Saves and loads trained networks so that training can be
+ *  resumed on rows appended to the IO data file since the last run.
+ * Author: agent
+ * Last Modified: 10/18/2026
+ *
+ * NOTES:
+ *  struct network is defined in ANN.c, allocateNetwork(..) in ANNManager.c
+ *  A checkpoint is a text file holding the topology, the translation
+ *   tables, every weight, rowCount: the number of leading rows of the IO
+ *   data file the network has seen, and [testStart, testEnd): the rows
+ *   held out for testing. Every row seen outside the test rows has been
+ *   trained on.
+ *  The test rows are fixed by the run which created the checkpoint, so a
+ *   row once tested on is never trained on. Rows appended later are all
+ *   training rows.
+ *  Output nodes decode their value by splitting [0, 1] into one bin per
+ *   translation entry, so an output character appended to a translation
+ *   table moves every bin of that node, and the trained weights of the
+ *   node would decode old rows to the wrong characters. When resuming,
+ *   resetOutputNodes(..) reinitializes the weights of every output node
+ *   whose translation table grew, and every old training row is then
+ *   replayed, whatever the replay ratio, so the reset nodes relearn them.
+ *  Checkpoints are written to a temporary file which is then renamed
+ *   over the old checkpoint, so readers never see a partial file.
+ *
+ *  checkpoint layout:
+ *   ANN checkpoint 3
+ *   inputLen outputLen layerCount rowCount testStart testEnd
+ *   nodeCounts[0] .. nodeCounts[layerCount-1]
+ *   activations[0] .. activations[layerCount-1]
+ *   one line per output node: count entries[0] .. entries[count-1]
+ *    (entries are written as character codes)
+ *   one line per node, layer by layer: weights[layer_i][node_i][..]
+ * ***********************************************************************
+ */
+
+#include <unistd.h>
+
+
+#define CHECKPOINT_VERSION 3
+
+// whether a checkpoint file exists to resume from
+int checkpointExists(char *filename) {
+	return access(filename, F_OK) == 0;
+}
+
+int saveCheckpoint(char *filename, struct network *network, int rowCount, int testStart, int testEnd) {
+	int outputLen = network->nodeCounts[network->layerCount-1];
+	char tmpName[strlen(filename)+5];
+	sprintf(tmpName, "%s.tmp", filename);
+
+	FILE *writefile;
+	if ((writefile = fopen(tmpName, "w")) == NULL) {
+		fprintf(stderr,"could not open file \"%s\"\n", tmpName);
+		return -1;
+	}
+
+	fprintf(writefile, "ANN checkpoint %d\n", CHECKPOINT_VERSION);
+	fprintf(writefile, "%d %d %d %d %d %d\n", network->inputLen, outputLen, network->layerCount, rowCount, testStart, testEnd);
+	for (int l_i=0; l_i<network->layerCount; l_i++)
+		fprintf(writefile, "%d%s", network->nodeCounts[l_i], l_i == network->layerCount-1 ? "\n" : " ");
+	for (int l_i=0; l_i<network->layerCount; l_i++)
+		fprintf(writefile, "%d%s", network->activations[l_i], l_i == network->layerCount-1 ? "\n" : " ");
+	for (int o_i=0; o_i<outputLen; o_i++) {
+		fprintf(writefile, "%d", network->translations[o_i].count);
+		for (int t_i=0; t_i<network->translations[o_i].count; t_i++)
+			fprintf(writefile, " %d", network->translations[o_i].entries[t_i]);
+		fprintf(writefile, "\n");
+	}
+	for (int l_i=0; l_i<network->layerCount; l_i++)
+		for (int n_i=0; n_i<network->nodeCounts[l_i]; n_i++) {
+			for (int w_i=0; w_i<=((l_i == 0) ? network->inputLen : network->nodeCounts[l_i-1]); w_i++)
+				fprintf(writefile, "%s%.17g", w_i ? " " : "", network->weights[l_i][n_i][w_i]);
+			fprintf(writefile, "\n");
+		}
+
+	if (fclose(writefile) != 0 || rename(tmpName, filename) != 0) {
+		fprintf(stderr,"could not write checkpoint \"%s\"\n", filename);
+		return -1;
+	}
+	return 0;
+}
+
+// reads the input and output vector lengths of a checkpoint
+int checkpointShape(char *filename, int *inputLen, int *outputLen) {
+	FILE *readfile;
+	if ((readfile = fopen(filename, "r")) == NULL) {
+		fprintf(stderr,"could not open file \"%s\"\n", filename);
+		return -1;
+	}
+	int version;
+	if (fscanf(readfile, "ANN checkpoint %d %d %d", &version, inputLen, outputLen) != 3 || version != CHECKPOINT_VERSION || *inputLen < 1 || *outputLen < 1) {
+		fprintf(stderr, "\"%s\" is not a valid checkpoint\n", filename);
+		fclose(readfile);
+		return -1;
+	}
+	fclose(readfile);
+	return 0;
+}
+
+// reads a checkpoint into network, storing each allocation in network or translations as it is made
+int readCheckpoint(FILE *readfile, char *filename, struct network *network, int inputLen, int outputLen, struct translation translations[], int *rowCount, int *testStart, int *testEnd) {
+	int version, fileInputLen, fileOutputLen, layerCount;
+	if (fscanf(readfile, "ANN checkpoint %d %d %d %d %d %d %d", &version, &fileInputLen, &fileOutputLen, &layerCount, rowCount, testStart, testEnd) != 7
+			|| version != CHECKPOINT_VERSION || layerCount < 1 || *testStart < 0 || *testStart > *testEnd || *testEnd > *rowCount) {
+		fprintf(stderr, "\"%s\" is not a valid checkpoint\n", filename);
+		return -1;
+	}
+	if (fileInputLen != inputLen || fileOutputLen != outputLen) {
+		fprintf(stderr, "checkpoint \"%s\" has %d inputs and %d outputs, IO data has %d and %d\n", filename, fileInputLen, fileOutputLen, inputLen, outputLen);
+		return -1;
+	}
+
+	int *nodeCounts;
+	if ((network->nodeCounts = nodeCounts = malloc(sizeof(int)*layerCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to checkpoint nodeCounts\n");
+		return -1;
+	}
+	for (int l_i=0; l_i<layerCount; l_i++)
+		if (fscanf(readfile, "%d", &nodeCounts[l_i]) != 1 || nodeCounts[l_i] < 1) {
+			fprintf(stderr, "\"%s\" is not a valid checkpoint\n", filename);
+			return -1;
+		}
+	if (nodeCounts[layerCount-1] != outputLen) {
+		fprintf(stderr, "\"%s\" is not a valid checkpoint\n", filename);
+		return -1;
+	}
+
+	int *activations;
+	if ((network->activations = activations = malloc(sizeof(int)*layerCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to checkpoint activations\n");
+		return -1;
+	}
+	for (int l_i=0; l_i<layerCount; l_i++) {
+		if (fscanf(readfile, "%d", &activations[l_i]) != 1 || activations[l_i] < 0 || activations[l_i] >= ACTIVATION_COUNT
+				|| (l_i == layerCount-1 && activations[l_i] != ACTIVATION_SIGMOID)) {
+			fprintf(stderr, "\"%s\" is not a valid checkpoint\n", filename);
+			return -1;
+		}
+	}
+
+	for (int o_i=0; o_i<outputLen; o_i++) {
+		if (fscanf(readfile, "%d", &translations[o_i].count) != 1 || translations[o_i].count < 1) {
+			fprintf(stderr, "\"%s\" is not a valid checkpoint\n", filename);
+			return -1;
+		}
+		if ((translations[o_i].entries = malloc(sizeof(char)*translations[o_i].count)) == NULL) {
+			fprintf(stderr, "failed to allocate memory to translations[%d].entries\n", o_i);
+			return -1;
+		}
+		for (int t_i=0; t_i<translations[o_i].count; t_i++) {
+			int entry;
+			if (fscanf(readfile, "%d", &entry) != 1) {
+				fprintf(stderr, "\"%s\" is not a valid checkpoint\n", filename);
+				return -1;
+			}
+			translations[o_i].entries[t_i] = (char)entry;
+		}
+	}
+
+	if (allocateNetwork(network, inputLen, layerCount, nodeCounts, activations, translations) < 0)
+		return -1;
+	for (int l_i=0; l_i<layerCount; l_i++)
+		for (int n_i=0; n_i<nodeCounts[l_i]; n_i++)
+			for (int w_i=0; w_i<=((l_i == 0) ? inputLen : nodeCounts[l_i-1]); w_i++)
+				if (fscanf(readfile, "%lf", &network->weights[l_i][n_i][w_i]) != 1) {
+					fprintf(stderr, "\"%s\" is not a valid checkpoint\n", filename);
+					return -1;
+				}
+
+	return 0;
+}
+
+/* builds network from checkpoint, network->nodeCounts and network->activations are malloc'd here and
+ * belong to the caller, translations must have room for outputLen entries
+ * on failure, nothing is left allocated
+ */
+int loadCheckpoint(char *filename, struct network *network, int inputLen, int outputLen, struct translation translations[], int *rowCount, int *testStart, int *testEnd) {
+	FILE *readfile;
+	if ((readfile = fopen(filename, "r")) == NULL) {
+		fprintf(stderr,"could not open file \"%s\"\n", filename);
+		return -1;
+	}
+	memset(network, 0, sizeof(struct network));
+	for (int o_i=0; o_i<outputLen; o_i++)
+		translations[o_i].entries = NULL;
+
+	int ret = readCheckpoint(readfile, filename, network, inputLen, outputLen, translations, rowCount, testStart, testEnd);
+	fclose(readfile);
+	if (ret < 0) {
+		cleanupNetwork(network);
+		free(network->nodeCounts);
+		free(network->activations);
+		cleanupTranslations(translations, outputLen);
+	}
+	return ret;
+}
+
+/* reinitializes the weights of output nodes whose translation table has grown since it held oldCounts[o_i] entries
+ * returns the number of nodes reset
+ */
+int resetOutputNodes(struct network *network, int oldCounts[]) {
+	int l_i = network->layerCount-1;
+	int reset = 0;
+	for (int o_i=0; o_i<network->nodeCounts[l_i]; o_i++)
+		if (network->translations[o_i].count != oldCounts[o_i]) {
+			randomizeNode(network, l_i, o_i);
+			reset++;
+		}
+	return reset;
+}
+
+/* gathers the rows to train on when resuming: every row in [rowCount, rowEnd),
+ * plus a random replayRatio of the rows in [0, rowCount) outside the test rows [testStart, testEnd),
+ * to keep old rows from being forgotten
+ * rows are shuffled so replayed rows are interleaved with new ones
+ * view->rows is malloc'd here, free with cleanupView(..)
+ */
+int buildResumeView(struct dataset *data, int rowCount, int rowEnd, int testStart, int testEnd, double replayRatio, struct datasetView *view) {
+	int newCount = rowEnd - rowCount;
+	int oldCount = rowCount - (testEnd - testStart);
+	int replayCount = (int)(oldCount*replayRatio);
+	view->data = data;
+	view->start = 0;
+	view->count = newCount + replayCount;
+	if ((view->rows = malloc(sizeof(int)*view->count)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to resume view rows\n");
+		return -1;
+	}
+	for (int v_i=0; v_i<newCount; v_i++)
+		view->rows[v_i] = rowCount+v_i;
+
+	// partial Fisher-Yates over old training row indices picks replayCount distinct rows
+	if (replayCount) {
+		int *old;
+		if ((old = malloc(sizeof(int)*oldCount)) == NULL) {
+			fprintf(stderr, "failed to allocate memory to replay indices\n");
+			return -1;
+		}
+		for (int r_i=0; r_i<oldCount; r_i++)
+			old[r_i] = r_i < testStart ? r_i : r_i + (testEnd - testStart);
+		for (int r_i=0; r_i<replayCount; r_i++) {
+			int pick = r_i + rand()%(oldCount-r_i);
+			int tmp = old[r_i];
+			old[r_i] = old[pick];
+			old[pick] = tmp;
+			view->rows[newCount+r_i] = old[r_i];
+		}
+		free(old);
+	}
+
+	// shuffle
+	for (int v_i=view->count-1; v_i>0; v_i--) {
+		int pick = rand()%(v_i+1);
+		int tmp = view->rows[v_i];
+		view->rows[v_i] = view->rows[pick];
+		view->rows[pick] = tmp;
+	}
+	return 0;
+}
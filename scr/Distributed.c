@@ -0,0 +1,549 @@
+/* ***********************************************************************
+ * Program: Distributed.c
+ * Description: Data-parallel training across worker processes which
+ *  share their progress through a parameter server.
+ * Author: agent
+ * Last Modified: 10/18/2026
+ *
+ * NOTES:
+ *  struct network is defined in ANN.c, trainEpoch(..) in ANNManager.c
+ *  Each worker trains its own copy of the network on a shard of the
+ *   training rows (a contiguous workerCount'th of them). On a NUMA
+ *   machine each shard's rows are moved to the node of the worker which
+ *   reads them, see placeView(..). After each epoch (a round)
+ *   it pushes the change in its weights since it last pulled, and pulls
+ *   the server's weights back.
+ *  The server adds each pushed delta / workerCount to its weights, so once
+ *   every worker has pushed a round, the server's weights have moved by
+ *   the average of the workers' deltas.
+ *  Staleness bounds how far workers may drift apart: a worker which has
+ *   finished round c is only answered once every worker has finished
+ *   round c-staleness. A staleness of 0 is synchronous averaging, every
+ *   worker pulls the same averaged weights after every round.
+ *  The server tracks accuracy per round (summed over all shards) and uses
+ *   the same convergence test as train(..). When it decides to stop, the
+ *   stop flag is set in every following reply.
+ *
+ *  Addresses are "host:port" for TCP, anything else is the path of a
+ *   Unix domain socket.
+ *  Messages are a header of MSG_HEADER_FIELDS 32 bit unsigned integers
+ *   followed by valueCount 64 bit IEEE-754 doubles, everything big-endian.
+ *   header: magic, type, worker, clock, correct, rows, flags, valueCount
+ *   MSG_HELLO   worker -> server, worker id, no values
+ *   MSG_WEIGHTS server -> worker, every weight of the network, flags may
+ *               hold MSG_FLAG_STOP
+ *   MSG_PUSH    worker -> server, clock is the round just trained, correct
+ *               and rows are the round's accuracy, values are weight deltas
+ * ***********************************************************************
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+
+#define MSG_MAGIC 0x414e4e31 // "ANN1"
+#define MSG_HEADER_FIELDS 8
+#define MSG_HELLO 1
+#define MSG_WEIGHTS 2
+#define MSG_PUSH 3
+#define MSG_FLAG_STOP 1
+#define CONNECT_ATTEMPTS 50 // workers retry every 100ms while the server starts
+
+struct message {
+	uint32_t type;
+	uint32_t worker;
+	uint32_t clock;
+	uint32_t correct;
+	uint32_t rows;
+	uint32_t flags;
+	uint32_t valueCount;
+	double *values;
+} message;
+
+/************************************** info about struct message:
+ * values: buffer of at least valueCount doubles, owned by the caller
+ * (magic is only present on the wire)
+ */
+
+
+// number of weights in network, including biases
+int weightCount(struct network *network) {
+	int count = 0;
+	for (int l_i=0; l_i<network->layerCount; l_i++)
+		count += network->nodeCounts[l_i]*((l_i == 0 ? network->inputLen : network->nodeCounts[l_i-1])+1);
+	return count;
+}
+
+// copies every weight of network into values, layer by layer, node by node
+void flattenWeights(struct network *network, double *values) {
+	int v_i = 0;
+	for (int l_i=0; l_i<network->layerCount; l_i++)
+		for (int n_i=0; n_i<network->nodeCounts[l_i]; n_i++)
+			for (int w_i=0; w_i<=((l_i == 0) ? network->inputLen : network->nodeCounts[l_i-1]); w_i++)
+				values[v_i++] = network->weights[l_i][n_i][w_i];
+}
+
+// copies values (as laid out by flattenWeights(..)) into network's weights
+void unflattenWeights(struct network *network, double *values) {
+	int v_i = 0;
+	for (int l_i=0; l_i<network->layerCount; l_i++)
+		for (int n_i=0; n_i<network->nodeCounts[l_i]; n_i++)
+			for (int w_i=0; w_i<=((l_i == 0) ? network->inputLen : network->nodeCounts[l_i-1]); w_i++)
+				network->weights[l_i][n_i][w_i] = values[v_i++];
+}
+
+
+// write or read exactly len bytes, -1 on error or closed connection
+int writeAll(int fd, unsigned char *buf, size_t len) {
+	while (len) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int readAll(int fd, unsigned char *buf, size_t len) {
+	while (len) {
+		ssize_t n = read(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+void encode32(unsigned char *buf, uint32_t v) {
+	for (int b_i=0; b_i<4; b_i++)
+		buf[b_i] = (unsigned char)(v >> (24 - 8*b_i));
+}
+
+uint32_t decode32(unsigned char *buf) {
+	uint32_t v = 0;
+	for (int b_i=0; b_i<4; b_i++)
+		v = (v << 8) | buf[b_i];
+	return v;
+}
+
+int sendMessage(int fd, struct message *msg) {
+	size_t len = 4*MSG_HEADER_FIELDS + 8*(size_t)msg->valueCount;
+	unsigned char *buf;
+	if ((buf = malloc(len)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to message buffer\n");
+		return -1;
+	}
+	uint32_t header[MSG_HEADER_FIELDS] = {MSG_MAGIC, msg->type, msg->worker, msg->clock, msg->correct, msg->rows, msg->flags, msg->valueCount};
+	for (int h_i=0; h_i<MSG_HEADER_FIELDS; h_i++)
+		encode32(buf + 4*h_i, header[h_i]);
+	for (uint32_t v_i=0; v_i<msg->valueCount; v_i++) {
+		uint64_t bits;
+		memcpy(&bits, &msg->values[v_i], sizeof(bits));
+		encode32(buf + 4*MSG_HEADER_FIELDS + 8*v_i, (uint32_t)(bits >> 32));
+		encode32(buf + 4*MSG_HEADER_FIELDS + 8*v_i + 4, (uint32_t)bits);
+	}
+	int ret = writeAll(fd, buf, len);
+	free(buf);
+	return ret;
+}
+
+// receives a message into msg, whose values must have room for maxValues
+int receiveMessage(int fd, struct message *msg, uint32_t maxValues) {
+	unsigned char header[4*MSG_HEADER_FIELDS];
+	if (readAll(fd, header, sizeof(header)) < 0)
+		return -1;
+	if (decode32(header) != MSG_MAGIC) {
+		fprintf(stderr, "received message with bad magic number\n");
+		return -1;
+	}
+	msg->type = decode32(header + 4);
+	msg->worker = decode32(header + 8);
+	msg->clock = decode32(header + 12);
+	msg->correct = decode32(header + 16);
+	msg->rows = decode32(header + 20);
+	msg->flags = decode32(header + 24);
+	msg->valueCount = decode32(header + 28);
+	if (msg->valueCount > maxValues) {
+		fprintf(stderr, "received message with %u values, expected at most %u\n", msg->valueCount, maxValues);
+		return -1;
+	}
+	if (msg->valueCount == 0)
+		return 0;
+	unsigned char *buf;
+	if ((buf = malloc(8*(size_t)msg->valueCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to message buffer\n");
+		return -1;
+	}
+	if (readAll(fd, buf, 8*(size_t)msg->valueCount) < 0) {
+		free(buf);
+		return -1;
+	}
+	for (uint32_t v_i=0; v_i<msg->valueCount; v_i++) {
+		uint64_t bits = ((uint64_t)decode32(buf + 8*v_i) << 32) | decode32(buf + 8*v_i + 4);
+		memcpy(&msg->values[v_i], &bits, sizeof(bits));
+	}
+	free(buf);
+	return 0;
+}
+
+
+// fills a TCP ("host:port") or Unix domain socket address, returns its length or -1
+socklen_t parseAddress(char *address, struct sockaddr_storage *addr) {
+	memset(addr, 0, sizeof(*addr));
+	char *colon = strrchr(address, ':');
+	if (colon == NULL) {
+		struct sockaddr_un *un = (struct sockaddr_un *)addr;
+		if (strlen(address) >= sizeof(un->sun_path)) {
+			fprintf(stderr, "socket path \"%s\" is too long\n", address);
+			return -1;
+		}
+		un->sun_family = AF_UNIX;
+		strcpy(un->sun_path, address);
+		return sizeof(struct sockaddr_un);
+	}
+	char host[colon-address+1];
+	memcpy(host, address, colon-address);
+	host[colon-address] = '\0';
+	struct addrinfo hints, *result;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if (getaddrinfo(host[0] ? host : NULL, colon+1, &hints, &result) != 0) {
+		fprintf(stderr, "could not resolve address \"%s\"\n", address);
+		return -1;
+	}
+	socklen_t len = result->ai_addrlen;
+	memcpy(addr, result->ai_addr, len);
+	freeaddrinfo(result);
+	return len;
+}
+
+// turns off Nagle's algorithm on TCP sockets, messages are sent whole
+void setNoDelay(int fd, struct sockaddr_storage *addr) {
+	int one = 1;
+	if (addr->ss_family == AF_INET)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int listenSocket(char *address, int backlog) {
+	struct sockaddr_storage addr;
+	socklen_t len;
+	if ((len = parseAddress(address, &addr)) == (socklen_t)-1)
+		return -1;
+	int fd;
+	if ((fd = socket(addr.ss_family, SOCK_STREAM, 0)) < 0) {
+		fprintf(stderr, "could not create socket for \"%s\"\n", address);
+		return -1;
+	}
+	int one = 1;
+	if (addr.ss_family == AF_UNIX)
+		unlink(address); // remove socket left by an earlier run
+	else
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, (struct sockaddr *)&addr, len) < 0 || listen(fd, backlog) < 0) {
+		fprintf(stderr, "could not listen on \"%s\"\n", address);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int connectSocket(char *address) {
+	struct sockaddr_storage addr;
+	socklen_t len;
+	if ((len = parseAddress(address, &addr)) == (socklen_t)-1)
+		return -1;
+	for (int a_i=0; a_i<CONNECT_ATTEMPTS; a_i++) {
+		int fd;
+		if ((fd = socket(addr.ss_family, SOCK_STREAM, 0)) < 0) {
+			fprintf(stderr, "could not create socket for \"%s\"\n", address);
+			return -1;
+		}
+		if (connect(fd, (struct sockaddr *)&addr, len) == 0) {
+			setNoDelay(fd, &addr);
+			return fd;
+		}
+		close(fd);
+		usleep(100000);
+	}
+	fprintf(stderr, "could not connect to \"%s\"\n", address);
+	return -1;
+}
+
+
+// view of the shard'th of shardCount contiguous, near equal parts of view
+int buildShardView(struct datasetView view, int shardCount, int shard, struct datasetView *shardView) {
+	int start = (int)((long)shard*view.count/shardCount);
+	int end = (int)((long)(shard+1)*view.count/shardCount);
+	shardView->data = view.data;
+	shardView->start = 0;
+	shardView->count = end - start;
+	if ((shardView->rows = malloc(sizeof(int)*(shardView->count ? shardView->count : 1))) == NULL) {
+		fprintf(stderr, "failed to allocate memory to shard view rows\n");
+		return -1;
+	}
+	for (int v_i=0; v_i<shardView->count; v_i++)
+		shardView->rows[v_i] = viewRow(view, start + v_i);
+	return 0;
+}
+
+
+/* trains network on shard, exchanging weights with the server at address after every epoch
+ * network must already be built, its weights are replaced by the server's on connection
+ */
+int runWorker(struct network *network, struct datasetView shard, char *address, int workerId, double learningRate) {
+	int fd;
+	if ((fd = connectSocket(address)) < 0)
+		return -1;
+	// on a NUMA machine workers are spread across nodes, weights are written (and so copied, if forked) on the worker's node
+	int node = pinThread(workerId);
+	if (node >= 0 && placeNetwork(network, node) < 0)
+		return -1;
+	int valueCount = weightCount(network);
+	double *base, *current;
+	if ((base = malloc(sizeof(double)*valueCount)) == NULL || (current = malloc(sizeof(double)*valueCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to worker weight buffers\n");
+		return -1;
+	}
+
+	struct message msg = {MSG_HELLO, workerId, 0, 0, 0, 0, 0, NULL};
+	if (sendMessage(fd, &msg) < 0) {
+		fprintf(stderr, "worker %d lost connection to server\n", workerId);
+		return -1;
+	}
+	msg.values = base;
+	if (receiveMessage(fd, &msg, valueCount) < 0 || msg.type != MSG_WEIGHTS || (int)msg.valueCount != valueCount) {
+		fprintf(stderr, "worker %d did not receive weights from server\n", workerId);
+		return -1;
+	}
+	unflattenWeights(network, base);
+
+	for (uint32_t clock=0; !(msg.flags & MSG_FLAG_STOP); clock++) {
+		int correct;
+		if ((correct = trainEpoch(network, shard, learningRate)) < 0)
+			return -1;
+
+		// push change in weights since last pull
+		flattenWeights(network, current);
+		for (int v_i=0; v_i<valueCount; v_i++)
+			current[v_i] -= base[v_i];
+		struct message push = {MSG_PUSH, workerId, clock, correct, shard.count, 0, valueCount, current};
+		if (sendMessage(fd, &push) < 0) {
+			fprintf(stderr, "worker %d lost connection to server\n", workerId);
+			return -1;
+		}
+
+		// pull server's weights
+		if (receiveMessage(fd, &msg, valueCount) < 0 || msg.type != MSG_WEIGHTS || (int)msg.valueCount != valueCount) {
+			fprintf(stderr, "worker %d did not receive weights from server\n", workerId);
+			return -1;
+		}
+		unflattenWeights(network, base);
+	}
+
+	close(fd);
+	free(base);
+	free(current);
+	return 0;
+}
+
+
+/* serves network's weights to workerCount workers connecting to listenFd, until
+ * maxEpoch rounds have completed or accuracy converges, leaves the final weights in network
+ */
+int runParameterServer(struct network *network, int listenFd, int workerCount, int maxEpoch, int precision, int convRange, int staleness) {
+	int valueCount = weightCount(network);
+	double *weights, *delta;
+	if ((weights = malloc(sizeof(double)*valueCount)) == NULL || (delta = malloc(sizeof(double)*valueCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to server weight buffers\n");
+		return -1;
+	}
+	flattenWeights(network, weights);
+
+	// per worker state, indexed by worker id
+	int fds[workerCount];
+	int clocks[workerCount]; // rounds the worker has pushed
+	int waiting[workerCount]; // treat as boolean, worker has pushed and awaits weights
+	int finished[workerCount]; // treat as boolean, worker has been sent the stop flag
+	// per round state
+	int *roundCorrect, *roundRows, *roundPushes;
+	if ((roundCorrect = calloc(maxEpoch, sizeof(int))) == NULL || (roundRows = calloc(maxEpoch, sizeof(int))) == NULL || (roundPushes = calloc(maxEpoch, sizeof(int))) == NULL) {
+		fprintf(stderr, "failed to allocate memory to server round buffers\n");
+		return -1;
+	}
+	int accuracy[convRange];
+	for (int c_i=0; c_i<convRange; c_i++)
+		accuracy[c_i] = 0;
+	int stop = 0; // treat as boolean
+	int round = 0; // next round to complete
+
+	// accept every worker and send it the starting weights
+	for (int w_i=0; w_i<workerCount; w_i++)
+		fds[w_i] = -1;
+	for (int c_i=0; c_i<workerCount; c_i++) {
+		int fd;
+		if ((fd = accept(listenFd, NULL, NULL)) < 0) {
+			fprintf(stderr, "parameter server could not accept worker\n");
+			return -1;
+		}
+		struct message msg = {0, 0, 0, 0, 0, 0, 0, NULL};
+		if (receiveMessage(fd, &msg, 0) < 0 || msg.type != MSG_HELLO || msg.worker >= (uint32_t)workerCount || fds[msg.worker] >= 0) {
+			fprintf(stderr, "parameter server received bad hello\n");
+			return -1;
+		}
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on Unix sockets
+		fds[msg.worker] = fd;
+		clocks[msg.worker] = 0;
+		waiting[msg.worker] = 0;
+		finished[msg.worker] = 0;
+		struct message reply = {MSG_WEIGHTS, msg.worker, 0, 0, 0, 0, valueCount, weights};
+		if (sendMessage(fd, &reply) < 0) {
+			fprintf(stderr, "parameter server lost connection to worker %d\n", msg.worker);
+			return -1;
+		}
+	}
+	fprintf(stdout, "Parameter server: %d workers connected, staleness %d\n", workerCount, staleness);
+
+	int finishedCount = 0;
+	while (finishedCount < workerCount) {
+		// wait for a push from any worker still training
+		struct pollfd pfds[workerCount];
+		for (int w_i=0; w_i<workerCount; w_i++) {
+			pfds[w_i].fd = (waiting[w_i] || finished[w_i]) ? -1 : fds[w_i];
+			pfds[w_i].events = POLLIN;
+			pfds[w_i].revents = 0;
+		}
+		if (poll(pfds, workerCount, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "parameter server poll failed\n");
+			return -1;
+		}
+
+		for (int w_i=0; w_i<workerCount; w_i++) {
+			if (!pfds[w_i].revents)
+				continue;
+			struct message msg = {0, 0, 0, 0, 0, 0, 0, delta};
+			if (receiveMessage(fds[w_i], &msg, valueCount) < 0 || msg.type != MSG_PUSH || (int)msg.valueCount != valueCount || (int)msg.clock != clocks[w_i]) {
+				fprintf(stderr, "parameter server lost connection to worker %d\n", w_i);
+				return -1;
+			}
+			// apply worker's share of the average
+			for (int v_i=0; v_i<valueCount; v_i++)
+				weights[v_i] += delta[v_i]/workerCount;
+			if ((int)msg.clock < maxEpoch) {
+				roundCorrect[msg.clock] += msg.correct;
+				roundRows[msg.clock] += msg.rows;
+				roundPushes[msg.clock]++;
+			}
+			clocks[w_i]++;
+			waiting[w_i] = 1;
+		}
+
+		// report rounds every worker has pushed, and check for convergence
+		while (!stop && round < maxEpoch && roundPushes[round] == workerCount) {
+			accuracy[round%convRange] = roundCorrect[round];
+			fprintf(stdout, "Round %3d accuracy: %4d / %d = %.2f%%\n", round, roundCorrect[round], roundRows[round], 100*roundCorrect[round]/(double)roundRows[round]);
+			round++;
+			if (round >= maxEpoch || !(100*precision*convergence(accuracy, convRange, round)/roundRows[round-1]))
+				stop = 1;
+		}
+
+		// answer waiting workers which are within staleness of the slowest worker
+		int slowest = clocks[0];
+		for (int w_i=1; w_i<workerCount; w_i++)
+			if (clocks[w_i] < slowest)
+				slowest = clocks[w_i];
+		for (int w_i=0; w_i<workerCount; w_i++) {
+			if (!waiting[w_i] || (!stop && clocks[w_i]-staleness > slowest))
+				continue;
+			struct message reply = {MSG_WEIGHTS, w_i, clocks[w_i], 0, 0, stop ? MSG_FLAG_STOP : 0, valueCount, weights};
+			if (sendMessage(fds[w_i], &reply) < 0) {
+				fprintf(stderr, "parameter server lost connection to worker %d\n", w_i);
+				return -1;
+			}
+			waiting[w_i] = 0;
+			if (stop) {
+				finished[w_i] = 1;
+				finishedCount++;
+			}
+		}
+	}
+
+	for (int w_i=0; w_i<workerCount; w_i++)
+		close(fds[w_i]);
+	unflattenWeights(network, weights);
+	free(weights);
+	free(delta);
+	free(roundCorrect);
+	free(roundRows);
+	free(roundPushes);
+	return 0;
+}
+
+
+/* runs a parameter server and workerCount workers on this machine, each worker a forked process
+ * network and view are inherited by the workers, the trained weights are left in network
+ */
+int trainDistributed(struct network *network, struct datasetView view, char *address, int workerCount, int maxEpoch, double learningRate, int precision, int convRange, int staleness) {
+	signal(SIGPIPE, SIG_IGN);
+	int listenFd;
+	if ((listenFd = listenSocket(address, workerCount)) < 0)
+		return -1;
+	fflush(stdout);
+
+	// shards are placed before forking, as workers only share the dataset's pages and can not move them
+	struct datasetView shards[workerCount];
+	for (int w_i=0; w_i<workerCount; w_i++) {
+		if (buildShardView(view, workerCount, w_i, &shards[w_i]) < 0)
+			return -1;
+		placeView(shards[w_i], w_i);
+	}
+
+	pid_t pids[workerCount];
+	for (int w_i=0; w_i<workerCount; w_i++) {
+		if ((pids[w_i] = fork()) < 0) {
+			fprintf(stderr, "could not fork worker %d\n", w_i);
+			return -1;
+		}
+		if (pids[w_i] == 0) {
+			// worker process
+			close(listenFd);
+			_exit(runWorker(network, shards[w_i], address, w_i, learningRate) < 0 ? 1 : 0);
+		}
+	}
+
+	int ret = runParameterServer(network, listenFd, workerCount, maxEpoch, precision, convRange, staleness);
+	close(listenFd);
+	if (strchr(address, ':') == NULL)
+		unlink(address);
+
+	for (int w_i=0; w_i<workerCount; w_i++) {
+		int status;
+		if (ret < 0)
+			kill(pids[w_i], SIGTERM);
+		if (waitpid(pids[w_i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "worker %d failed\n", w_i);
+			ret = -1;
+		}
+	}
+	for (int w_i=0; w_i<workerCount; w_i++)
+		cleanupView(&shards[w_i]);
+	return ret;
+}
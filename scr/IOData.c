@@ -5,17 +5,26 @@
  *  to interpret stored data.
  * Author: Samuel Shinn
  * Last Modified: 11/12/2017
- * 
+ *
  * NOTES:
- *  The function parseArgs(..) is the function called by other files.
- *  The structure of this file is generally that parseArgs(..),
- *   for each of the fields in struct paramater, calls a corresponding
- *   function to determine the field's value.
- *  The functions each search argv for a flag and return the corresponding
- *   input value if supplied, or indicate an error, or return a default 
- *   value if no flag is supplied.
- *  The field char *filename does not need a flag and will raise an error
- *   if it is not detected.
+ *  Data is stored by column rather than by row. Every column (output
+ *   columns first, as in the csv file) has a dictionary which gives
+ *   each distinct character in the column a small code.
+ *  Rows are grouped into blocks of BLOCK_ROWS. Within a block, each
+ *   column's codes are bit-packed into 64 bit words using just enough
+ *   bits for the column's dictionary, e.g. 4 bits for a column with at
+ *   most 16 distinct characters. Codes never straddle two words.
+ *  Rows are read back one at a time into char vectors by getRow(..),
+ *   which is what the ANN consumes.
+ *  A struct datasetView names the rows a function should work on, either
+ *   a contiguous range (e.g. the training or testing partition) or an
+ *   explicit list of rows.
+ *  Blocks' words are carved out of slabs of DATASET_SLAB bytes from
+ *   allocLarge(..) (Memory.c), so they sit on huge pages. Slabs' pages
+ *   are interleaved across NUMA nodes, as most modes read every row from
+ *   every thread. Where a thread reads only some rows (a worker's shard,
+ *   see Distributed.c), placeView(..) moves the blocks holding them to
+ *   the thread's node.
  * ***********************************************************************
  */
 
@@ -23,98 +32,426 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 
-struct IOData {
-	char *input;
-	char *output;
-} IOData;
+#define BLOCK_ROWS 1024 // rows per block of a dataset
+#define DATASET_SLAB (MEMORY_HUGE_PAGE - MEMORY_HEADER) // bytes of block words allocated at once, with allocLarge(..)'s header exactly a huge page
+
+struct dictionary {
+	int count;
+	char symbols[256];
+	short codes[256];
+} dictionary;
+
+struct block {
+	int rowCount;
+	unsigned char *widths;
+	int *offsets;
+	uint64_t *words;
+	int slab;
+} block;
+
+struct dataset {
+	int inputLen;
+	int outputLen;
+	int rowCount;
+	struct dictionary *dictionaries;
+	int blockCount;
+	int blockCapacity;
+	struct block *blocks;
+	unsigned char *pending;
+	int pendingCount;
+	uint64_t **slabs;
+	int slabCount;
+	int slabCapacity;
+	size_t slabUsed;
+	size_t slabSize;
+} dataset;
+
+struct datasetView {
+	struct dataset *data;
+	int start;
+	int count;
+	int *rows;
+} datasetView;
 
 struct translation {
 	int count;
 	char *entries;
 } translation;
 
-int getData(struct IOData io[], char *filename, int IOCount, int inputLen, int outputLen);
-int buildTranslationMatrix(int IOCount, int outputLen, struct IOData io[], struct translation translations[]);
-void displayIO(int IOCount, int inputLen, int outputLen, struct IOData io[]);
+/************************************** info about struct dataset:
+ * inputLen, outputLen: length of input and output vector of each row
+ * rowCount: number of rows stored in sealed blocks
+ * dictionaries: one per column, output columns first
+ *  count: number of distinct characters seen in column
+ *  symbols: code -> character
+ *  codes: character -> code, -1 if character not seen in column
+ * blocks: sealed blocks of BLOCK_ROWS rows (last block may be shorter)
+ *  widths: bits per code, per column
+ *  offsets: index of each column's first word in words
+ *  words: every column's packed codes, one column after another
+ *  slab: index of the slab words was carved from
+ * pending: codes of rows not yet sealed into a block, row-major
+ * slabs: memory blocks' words are carved from, interleaved across NUMA nodes
+ *  slabUsed, slabSize: bytes used and allocated of the last slab
+ *
+ * length of dictionaries, widths, offsets = outputLen + inputLen
+ * length of blocks = blockCapacity, of which blockCount are in use
+ * length of pending = BLOCK_ROWS * (outputLen + inputLen)
+ * length of slabs = slabCapacity, of which slabCount are in use
+ *
+ * info about struct datasetView:
+ * rows of the view are data->rows[i] for i in [0, count) if rows is
+ *  given, otherwise start + i
+ */
 
-// stores data in provided IOData array, parsed from file named filename
-int getData(struct IOData io[], char *filename, int IOCount, int inputLen, int outputLen) {
-	// malloc int* for every i,o pair
-	for (int i=0; i<IOCount; i++) {
-		if ((io[i].input = malloc(inputLen * sizeof(int))) == NULL) {
-			fprintf(stderr, "failed to allocate memory to struct IOData io[%d].input\n", i);
-			return -1;
+int buildDataset(struct dataset *data, int inputLen, int outputLen);
+int appendRow(struct dataset *data, char *output, char *input);
+int sealBlock(struct dataset *data);
+int reserveBlocks(struct dataset *data, int rowCount);
+void skipHeader(FILE *readfile, char *buf, int bufLen);
+int parseRow(struct dataset *data, char *buf);
+int getData(struct dataset *data, char *filename, int inputLen, int outputLen);
+void getRow(struct dataset *data, int row, char *input, char *output);
+int buildTranslationMatrix(struct dataset *data, struct translation translations[]);
+int growTranslationMatrix(struct dataset *data, struct translation translations[], int symbolCounts[]);
+void displayIO(struct datasetView view);
+
+int buildDataset(struct dataset *data, int inputLen, int outputLen) {
+	int columnCount = inputLen + outputLen;
+	data->inputLen = inputLen;
+	data->outputLen = outputLen;
+	data->rowCount = 0;
+	data->blockCount = 0;
+	data->blockCapacity = 0;
+	data->blocks = NULL;
+	data->pendingCount = 0;
+	data->slabs = NULL;
+	data->slabCount = 0;
+	data->slabCapacity = 0;
+	data->slabUsed = 0;
+	data->slabSize = 0;
+	if ((data->dictionaries = malloc(sizeof(struct dictionary)*columnCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to struct dataset data->dictionaries\n");
+		return -1;
+	}
+	for (int c_i=0; c_i<columnCount; c_i++) {
+		data->dictionaries[c_i].count = 0;
+		for (int e_i=0; e_i<256; e_i++)
+			data->dictionaries[c_i].codes[e_i] = -1;
+	}
+	if ((data->pending = malloc(sizeof(unsigned char)*BLOCK_ROWS*columnCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to struct dataset data->pending\n");
+		return -1;
+	}
+	return 0;
+}
+
+// dictionary encodes a row into the pending block, sealing the block once it is full
+int appendRow(struct dataset *data, char *output, char *input) {
+	int columnCount = data->inputLen + data->outputLen;
+	unsigned char *codes = data->pending + data->pendingCount*columnCount;
+	for (int c_i=0; c_i<columnCount; c_i++) {
+		struct dictionary *dict = &data->dictionaries[c_i];
+		unsigned char c = (unsigned char)(c_i < data->outputLen ? output[c_i] : input[c_i-data->outputLen]);
+		if (dict->codes[c] < 0) {
+			dict->codes[c] = dict->count;
+			dict->symbols[dict->count++] = (char)c;
+		}
+		codes[c_i] = (unsigned char)dict->codes[c];
+	}
+	if (++data->pendingCount == BLOCK_ROWS)
+		return sealBlock(data);
+	return 0;
+}
+
+// bits needed to store codes of a dictionary with count entries
+int codeWidth(int count) {
+	int width = 1;
+	while ((1 << width) < count)
+		width++;
+	return width;
+}
+
+// makes room for rowCount rows in the block directory, so sealing that many rows never moves it
+int reserveBlocks(struct dataset *data, int rowCount) {
+	int capacity = (rowCount + BLOCK_ROWS-1) / BLOCK_ROWS;
+	if (capacity <= data->blockCapacity)
+		return 0;
+	struct block *grown;
+	if ((grown = realloc(data->blocks, sizeof(struct block)*capacity)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to struct dataset data->blocks\n");
+		return -1;
+	}
+	data->blocks = grown;
+	data->blockCapacity = capacity;
+	return 0;
+}
+
+// zeroed words for a block, carved from the last slab, or from a new slab
+uint64_t *allocateWords(struct dataset *data, int wordCount) {
+	size_t bytes = sizeof(uint64_t)*wordCount;
+	if (data->slabCount == 0 || data->slabUsed + bytes > data->slabSize) {
+		if (data->slabCount == data->slabCapacity) {
+			int capacity = data->slabCapacity ? data->slabCapacity*2 : 16;
+			uint64_t **grown;
+			if ((grown = realloc(data->slabs, sizeof(uint64_t *)*capacity)) == NULL) {
+				fprintf(stderr, "failed to allocate memory to struct dataset data->slabs\n");
+				return NULL;
+			}
+			data->slabs = grown;
+			data->slabCapacity = capacity;
 		}
-		if ((io[i].output = malloc(outputLen * sizeof(int))) == NULL) {
-			fprintf(stderr, "failed to allocate memory to struct IOData io[%d].output\n", i);
+		size_t size = bytes > DATASET_SLAB ? bytes : DATASET_SLAB;
+		if ((data->slabs[data->slabCount] = allocLarge(size, NODE_INTERLEAVE)) == NULL) {
+			fprintf(stderr, "failed to allocate memory to struct dataset data->slabs[%d]\n", data->slabCount);
+			return NULL;
+		}
+		data->slabCount++;
+		data->slabUsed = 0;
+		data->slabSize = size;
+	}
+	uint64_t *words = data->slabs[data->slabCount-1] + data->slabUsed/sizeof(uint64_t);
+	memset(words, 0, bytes);
+	data->slabUsed += bytes;
+	return words;
+}
+
+// bit-packs pending rows into a new block
+int sealBlock(struct dataset *data) {
+	if (data->pendingCount == 0)
+		return 0;
+	int columnCount = data->inputLen + data->outputLen;
+	if (data->blockCount == data->blockCapacity) {
+		int capacity = data->blockCapacity ? data->blockCapacity*2 : 16;
+		struct block *grown;
+		if ((grown = realloc(data->blocks, sizeof(struct block)*capacity)) == NULL) {
+			fprintf(stderr, "failed to allocate memory to struct dataset data->blocks\n");
 			return -1;
 		}
+		data->blocks = grown;
+		data->blockCapacity = capacity;
+	}
+	struct block *block = &data->blocks[data->blockCount];
+	block->rowCount = data->pendingCount;
+	if ((block->widths = malloc(sizeof(unsigned char)*columnCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to struct block block->widths\n");
+		return -1;
+	}
+	if ((block->offsets = malloc(sizeof(int)*columnCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to struct block block->offsets\n");
+		return -1;
+	}
+	// lay out columns one after another, each using as many words as its width requires
+	int wordCount = 0;
+	for (int c_i=0; c_i<columnCount; c_i++) {
+		block->widths[c_i] = codeWidth(data->dictionaries[c_i].count);
+		int codesPerWord = 64 / block->widths[c_i];
+		block->offsets[c_i] = wordCount;
+		wordCount += (block->rowCount + codesPerWord - 1) / codesPerWord;
 	}
-	
+	if ((block->words = allocateWords(data, wordCount)) == NULL)
+		return -1;
+	block->slab = data->slabCount-1;
+	for (int c_i=0; c_i<columnCount; c_i++) {
+		int width = block->widths[c_i];
+		int codesPerWord = 64 / width;
+		uint64_t *column = block->words + block->offsets[c_i];
+		for (int r_i=0; r_i<block->rowCount; r_i++)
+			column[r_i/codesPerWord] |= (uint64_t)data->pending[r_i*columnCount + c_i] << ((r_i%codesPerWord)*width);
+	}
+	data->blockCount++;
+	data->rowCount += data->pendingCount;
+	data->pendingCount = 0;
+	return 0;
+}
+
+// stores data in provided dataset, parsed from file named filename
+// skips the first line of readfile (column headers)
+void skipHeader(FILE *readfile, char *buf, int bufLen) {
+	while ((fgets(buf, bufLen, readfile) != NULL) && buf[strlen(buf)-1] != '\n');
+}
+
+/* parses a line of the csv file (read into a buffer of (inputLen+outputLen)*2+2 chars) into data
+ * returns 0, or 1 if the line was blank and skipped, or -1 on error
+ */
+int parseRow(struct dataset *data, char *buf) {
+	int columnCount = data->inputLen + data->outputLen;
+	char input[data->inputLen];
+	char output[data->outputLen];
+	int len = strcspn(buf, "\r\n");
+	if (len == 0)
+		return 1;
+	if (len < columnCount*2-1) {
+		fprintf(stderr, "row %d of IO data has fewer than %d values\n", data->rowCount+data->pendingCount+1, columnCount);
+		return -1;
+	}
+	// first outputLen values are output
+	for (int out_i=0; out_i<data->outputLen; out_i++)
+		output[out_i] = buf[out_i*2];
+	// next inputLen values are input
+	for (int in_i=0; in_i<data->inputLen; in_i++)
+		input[in_i] = buf[(data->outputLen+in_i)*2];
+	return appendRow(data, output, input);
+}
+
+int getData(struct dataset *data, char *filename, int inputLen, int outputLen) {
+	if (buildDataset(data, inputLen, outputLen) < 0)
+		return -1;
+
 	// open file
 	FILE *readfile;
 	if ((readfile = fopen(filename, "r")) == NULL) {
 		fprintf(stderr,"could not open file \"%s\"\n", filename);
 		return -1;
 	}
-	
-	// prepare read buffer
-	int bufLen = (inputLen+outputLen)*2+1;
-	char buf[bufLen]; 
-	
-	// skip first line of file (column headers)
-	while ((fgets(buf, bufLen, readfile) != NULL) && buf[strlen(buf)-1] != '\n');
-	
-	// parse each line from readfile into io[]
-	for (int io_i = 0; (io_i < IOCount) && (fgets(buf, bufLen, readfile) != NULL); io_i++) {
-		// store first outputLen values in io[io_i].output
-		for (int out_i=0; out_i<outputLen; out_i++)
-			io[io_i].output[out_i] = buf[out_i*2];
-		// store next inputLen values in io[io_i].input
-		for (int in_i=0; in_i<inputLen; in_i++)
-			io[io_i].input[in_i] = buf[(outputLen+in_i)*2];
-	}
-	
+
+	// prepare read buffer, with room for a "\r\n" line ending
+	int bufLen = (inputLen+outputLen)*2+2;
+	char buf[bufLen];
+
+	skipHeader(readfile, buf, bufLen);
+
+	// parse each line from readfile into data
+	while (fgets(buf, bufLen, readfile) != NULL)
+		if (parseRow(data, buf) < 0) {
+			fclose(readfile);
+			return -1;
+		}
+
 	fclose(readfile);
-	return 0;
+	return sealBlock(data);
+}
+
+// unpacks a row of data into input and output vectors
+void getRow(struct dataset *data, int row, char *input, char *output) {
+	struct block *block = &data->blocks[row / BLOCK_ROWS];
+	int r_i = row % BLOCK_ROWS;
+	for (int c_i=0; c_i<data->inputLen+data->outputLen; c_i++) {
+		int width = block->widths[c_i];
+		int codesPerWord = 64 / width;
+		uint64_t word = block->words[block->offsets[c_i] + r_i/codesPerWord];
+		char c = data->dictionaries[c_i].symbols[(word >> ((r_i%codesPerWord)*width)) & ((1ULL << width) - 1)];
+		if (c_i < data->outputLen)
+			output[c_i] = c;
+		else
+			input[c_i-data->outputLen] = c;
+	}
+}
+
+// number of words a block's packed codes take up
+int blockWords(struct dataset *data, struct block *block) {
+	int last = data->inputLen + data->outputLen - 1;
+	int codesPerWord = 64 / block->widths[last];
+	return block->offsets[last] + (block->rowCount + codesPerWord - 1) / codesPerWord;
+}
+
+// bytes used to store a dataset's rows
+size_t datasetBytes(struct dataset *data) {
+	size_t bytes = sizeof(struct dictionary)*(data->inputLen+data->outputLen);
+	for (int b_i=0; b_i<data->blockCount; b_i++) {
+		int columnCount = data->inputLen + data->outputLen;
+		bytes += sizeof(struct block) + columnCount*(sizeof(unsigned char)+sizeof(int));
+		bytes += sizeof(uint64_t)*blockWords(data, &data->blocks[b_i]);
+	}
+	return bytes;
+}
+
+// view of rows [start, start+count)
+struct datasetView viewRange(struct dataset *data, int start, int count) {
+	struct datasetView view = {data, start, count, NULL};
+	return view;
+}
+
+// row of data which is the v_i'th row of view
+int viewRow(struct datasetView view, int v_i) {
+	return view.rows ? view.rows[v_i] : view.start + v_i;
+}
+
+// unpacks the v_i'th row of view into input and output vectors
+void getViewRow(struct datasetView view, int v_i, char *input, char *output) {
+	getRow(view.data, viewRow(view, v_i), input, output);
+}
+
+/* moves the blocks holding view's rows to a NUMA node (see Memory.c), e.g. that of the thread which will read them
+ * a block holding rows of several views ends up on the node of whichever view was placed last
+ */
+void placeView(struct datasetView view, int node) {
+	int placed = -1; // last block placed, consecutive rows are mostly in the same block
+	for (int v_i=0; v_i<view.count; v_i++) {
+		int b_i = viewRow(view, v_i) / BLOCK_ROWS;
+		if (b_i == placed)
+			continue;
+		struct block *block = &view.data->blocks[b_i];
+		movePart(view.data->slabs[block->slab], block->words, sizeof(uint64_t)*blockWords(view.data, block), node);
+		placed = b_i;
+	}
 }
 
 // builds translation tables between output nodes and output characters
-int buildTranslationMatrix(int IOCount, int outputLen, struct IOData io[], struct translation translations[]) {
-	int entries[256]; // one entry for each possible char
-	
-	for (int out_i=0; out_i<outputLen; out_i++) {
-		// clear entries
-		for (int e_i=0; e_i<256; e_i++)
-			entries[e_i] = 0;
-		
-		// for each io pair, flag element in entries for output
-		for (int io_i=0; io_i<IOCount; io_i++)
-			entries[(int)(io[io_i].output[out_i])] = 1;
-		
-		// count entries
-		translations[out_i].count = 0;
-		for (int e_i=0; e_i<256; e_i++)
-			if (entries[e_i])
-				translations[out_i].count++;
-		
+int buildTranslationMatrix(struct dataset *data, struct translation translations[]) {
+	for (int out_i=0; out_i<data->outputLen; out_i++) {
+		// every character seen in the output column is in its dictionary
+		translations[out_i].count = data->dictionaries[out_i].count;
+
 		// malloc char[] for each output node
 		if ((translations[out_i].entries = malloc(sizeof(char)*translations[out_i].count)) == NULL) {
 			fprintf(stderr, "failed to allocate memory to translations[%d].entries\n", out_i);
 			return -1;
 		}
-		
-		// store unique outputs in node's char[]
+
+		// store unique outputs in node's char[], in character order
 		int t_i = 0;
 		for (int e_i=0; e_i<256; e_i++)
-			if (entries[e_i])
+			if (data->dictionaries[out_i].codes[e_i] >= 0)
 				translations[out_i].entries[t_i++] = (char)e_i;
 	}
 	return 0;
 }
 
+/* appends output characters not yet in existing translation tables (e.g. loaded from a checkpoint)
+ * existing entries keep their index, so new characters are placed after them, but every entry's range of
+ *  output values narrows (see translateOutput(..)), so a trained output node decodes to the wrong characters
+ *  until it is retrained (see Checkpoint.c)
+ * symbolCounts, if given, limits each output column to the symbols its dictionary held at some point
+ *  (see Loader.c), otherwise every character seen in the column is used
+ * returns the number of characters added, or -1 on error
+ */
+int growTranslationMatrix(struct dataset *data, struct translation translations[], int symbolCounts[]) {
+	int entries[256]; // one entry for each possible char
+	int added = 0;
+
+	for (int out_i=0; out_i<data->outputLen; out_i++) {
+		// flag every character seen in the output column, or in its first symbolCounts[out_i] dictionary symbols
+		int count = symbolCounts ? symbolCounts[out_i] : data->dictionaries[out_i].count;
+		for (int e_i=0; e_i<256; e_i++)
+			entries[e_i] = 0;
+		for (int s_i=0; s_i<count; s_i++)
+			entries[(unsigned char)data->dictionaries[out_i].symbols[s_i]] = 1;
+
+		// unflag characters already in node's char[]
+		for (int t_i=0; t_i<translations[out_i].count; t_i++)
+			entries[(unsigned char)(translations[out_i].entries[t_i])] = 0;
+
+		// append remaining characters to node's char[]
+		for (int e_i=0; e_i<256; e_i++) {
+			if (!entries[e_i])
+				continue;
+			char *grown;
+			if ((grown = realloc(translations[out_i].entries, sizeof(char)*(translations[out_i].count+1))) == NULL) {
+				fprintf(stderr, "failed to allocate memory to translations[%d].entries\n", out_i);
+				return -1;
+			}
+			translations[out_i].entries = grown;
+			translations[out_i].entries[translations[out_i].count++] = (char)e_i;
+			added++;
+		}
+	}
+	return added;
+}
+
 // performs translation on data (desired) output, character -> number
 double translateOutput(char c, struct translation translationSet) {
 	for (int t_i=0; t_i<translationSet.count; t_i++)
@@ -129,31 +466,43 @@ double translateInput(char c) {
 	return c/256.0;
 }
 
-void displayIO(int IOCount, int inputLen, int outputLen, struct IOData io[]) {
-	for (int io_i=0; io_i<IOCount; io_i++) {
-		fprintf(stdout, "IOData[%d]: input: %c",io_i, (char)io[io_i].input[0]);
-		
-		for (int in_i=1; in_i<inputLen; in_i++)
-			fprintf(stdout, ", %c", (char)io[io_i].input[in_i]);
-		
-		fprintf(stdout, "  output: %c", (char)io[io_i].output[0]);
-		for (int out_i=1; out_i<outputLen; out_i++)
-			fprintf(stdout, ", %c", (char)io[io_i].output[out_i]);
-		
+void displayIO(struct datasetView view) {
+	char input[view.data->inputLen];
+	char output[view.data->outputLen];
+	for (int v_i=0; v_i<view.count; v_i++) {
+		getViewRow(view, v_i, input, output);
+		fprintf(stdout, "IOData[%d]: input: %c", viewRow(view, v_i), input[0]);
+
+		for (int in_i=1; in_i<view.data->inputLen; in_i++)
+			fprintf(stdout, ", %c", input[in_i]);
+
+		fprintf(stdout, "  output: %c", output[0]);
+		for (int out_i=1; out_i<view.data->outputLen; out_i++)
+			fprintf(stdout, ", %c", output[out_i]);
+
 		fprintf(stdout, "\n");
 	}
 }
 
-void cleanupIO(struct IOData *io, int IOCount) {
-	for (int io_i=0; io_i<IOCount; io_i++) {
-		free(io[io_i].input);
-		free(io[io_i].output);
+void cleanupView(struct datasetView *view) {
+	free(view->rows);
+	view->rows = NULL;
+}
+
+void cleanupDataset(struct dataset *data) {
+	for (int b_i=0; b_i<data->blockCount; b_i++) {
+		free(data->blocks[b_i].widths);
+		free(data->blocks[b_i].offsets);
 	}
+	for (int s_i=0; s_i<data->slabCount; s_i++)
+		freeLarge(data->slabs[s_i]);
+	free(data->slabs);
+	free(data->blocks);
+	free(data->dictionaries);
+	free(data->pending);
 }
 
 void cleanupTranslations(struct translation *translations, int outputLen) {
 	for (int o_i=0; o_i<outputLen; o_i++)
 		free(translations[o_i].entries);
 }
-
-
@@ -0,0 +1,176 @@
+/* ***********************************************************************
+ * Program: KFold.c
+ * Description: k-fold cross-validation, training every fold's network
+ *  at the same time on a pool of threads.
+ * Author: agent
+ * Last Modified: 10/18/2026
+ *
+ * NOTES:
+ *  struct network is defined in ANN.c, trainEpoch(..) in ANNManager.c,
+ *   clockSeconds(..) in Autotune.c
+ *  The rows of the dataset are split into folds of (nearly) equal size,
+ *   in file order. Fold f's network is tested on fold f and trained on
+ *   every other fold.
+ *  All folds share the dataset and translations, which are only read
+ *   while training. Each fold has its own network, built (and its weights
+ *   randomized) before any thread starts, since rand() is not thread safe.
+ *  Threads take the next untrained fold until none are left, so a pool of
+ *   at least foldCount threads trains every fold at once.
+ *  On a NUMA machine threads are pinned to nodes in turn, and a fold's
+ *   weights are moved to the node of the thread which takes it.
+ *  Folds are trained as by train(..), stopping at maxEpoch or convergence,
+ *   without per epoch output.
+ * ***********************************************************************
+ */
+
+#include <pthread.h>
+
+
+struct fold {
+	struct network network;
+	struct datasetView trainView;
+	struct datasetView testView;
+	int epochs;
+	double trainAccuracy;
+	double testAccuracy;
+	double wallSeconds;
+	double cpuSeconds;
+	int failed;
+} fold;
+
+struct foldPool {
+	pthread_mutex_t lock;
+	int next;
+	int started;
+	int foldCount;
+	struct fold *folds;
+	int maxEpoch;
+	double learningRate;
+	int precision;
+	int convRange;
+} foldPool;
+
+/************************************** info about struct foldPool:
+ * lock: guards next, started
+ * next: index of the next fold to be taken by a thread
+ * started: number of threads started, numbers threads for pinning
+ * folds: every fold, length foldCount
+ * maxEpoch, learningRate, precision, convRange: as given to train(..)
+ */
+
+
+// trains a fold's network until maxEpoch or convergence, as train(..) does
+int trainFold(struct fold *f, struct foldPool *pool) {
+	int accuracy[pool->convRange];
+	for (int c_i=0; c_i<pool->convRange; c_i++)
+		accuracy[c_i] = 0;
+	int epoch = 0;
+	do {
+		if ((accuracy[epoch%pool->convRange] = trainEpoch(&f->network, f->trainView, pool->learningRate)) < 0)
+			return -1;
+	} while ((++epoch < pool->maxEpoch) && 100*pool->precision*convergence(accuracy, pool->convRange, epoch)/f->trainView.count);
+	f->epochs = epoch;
+	f->trainAccuracy = 100.0*accuracy[(epoch-1)%pool->convRange]/f->trainView.count;
+	return 0;
+}
+
+void *foldThread(void *arg) {
+	struct foldPool *pool = arg;
+	char input[pool->folds[0].network.inputLen];
+	char desired[pool->folds[0].network.nodeCounts[pool->folds[0].network.layerCount-1]];
+	pthread_mutex_lock(&pool->lock);
+	int t_i = pool->started++;
+	pthread_mutex_unlock(&pool->lock);
+	int node = pinThread(t_i);
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		int f_i = pool->next < pool->foldCount ? pool->next++ : -1;
+		pthread_mutex_unlock(&pool->lock);
+		if (f_i < 0)
+			return NULL;
+
+		struct fold *f = &pool->folds[f_i];
+		if (node >= 0 && placeNetwork(&f->network, node) < 0) {
+			f->failed = 1;
+			continue;
+		}
+		double wallStart = clockSeconds(CLOCK_MONOTONIC);
+		double cpuStart = clockSeconds(CLOCK_THREAD_CPUTIME_ID);
+		f->failed = trainFold(f, pool) < 0;
+		f->wallSeconds = clockSeconds(CLOCK_MONOTONIC) - wallStart;
+		f->cpuSeconds = clockSeconds(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+
+		int correct = 0;
+		for (int v_i=0; v_i<f->testView.count; v_i++)
+			correct += evaluateRow(&f->network, f->testView, v_i, input, desired);
+		f->testAccuracy = 100.0*correct/f->testView.count;
+	}
+}
+
+/* trains and tests foldCount networks of the given topology on threadCount threads,
+ * prints each fold's accuracy and timing, and the mean and variance of test accuracy
+ */
+int crossValidate(struct dataset *data, int foldCount, int threadCount, int layerCount, int nodeCounts[], int activations[], struct translation translations[], int maxEpoch, double learningRate, int precision, int convRange) {
+	if (foldCount > data->rowCount) {
+		fprintf(stderr, "number of folds must not exceed number of rows (%d)\n", data->rowCount);
+		return -1;
+	}
+	struct fold folds[foldCount];
+	struct foldPool pool = {PTHREAD_MUTEX_INITIALIZER, 0, 0, foldCount, folds, maxEpoch, learningRate, precision, convRange};
+
+	// fold f_i tests on rows [start, end) and trains on the rest
+	srand(time(NULL));
+	for (int f_i=0; f_i<foldCount; f_i++) {
+		int start = (int)((long)f_i*data->rowCount/foldCount);
+		int end = (int)((long)(f_i+1)*data->rowCount/foldCount);
+		folds[f_i].testView = viewRange(data, start, end-start);
+		folds[f_i].trainView.data = data;
+		folds[f_i].trainView.start = 0;
+		folds[f_i].trainView.count = data->rowCount - (end-start);
+		if ((folds[f_i].trainView.rows = malloc(sizeof(int)*folds[f_i].trainView.count)) == NULL) {
+			fprintf(stderr, "failed to allocate memory to fold %d rows\n", f_i);
+			return -1;
+		}
+		int v_i = 0;
+		for (int r_i=0; r_i<data->rowCount; r_i++)
+			if (r_i < start || r_i >= end)
+				folds[f_i].trainView.rows[v_i++] = r_i;
+		if (allocateNetwork(&folds[f_i].network, data->inputLen, layerCount, nodeCounts, activations, translations) < 0)
+			return -1;
+		randomizeWeights(&folds[f_i].network);
+	}
+
+	if (threadCount > foldCount)
+		threadCount = foldCount;
+	fprintf(stdout, "Training %d folds on %d threads\n", foldCount, threadCount);
+	double wallStart = clockSeconds(CLOCK_MONOTONIC);
+	pthread_t threads[threadCount];
+	for (int t_i=0; t_i<threadCount; t_i++)
+		if (pthread_create(&threads[t_i], NULL, foldThread, &pool) != 0) {
+			fprintf(stderr, "could not create thread %d\n", t_i);
+			return -1;
+		}
+	for (int t_i=0; t_i<threadCount; t_i++)
+		pthread_join(threads[t_i], NULL);
+	double wallSeconds = clockSeconds(CLOCK_MONOTONIC) - wallStart;
+
+	double sum = 0.0, sumSquares = 0.0, cpuSeconds = 0.0;
+	for (int f_i=0; f_i<foldCount; f_i++) {
+		if (folds[f_i].failed)
+			return -1;
+		fprintf(stdout, "Fold %2d: %4d epochs   training accuracy: %6.2f%%   test accuracy: %6.2f%%   time: %.2fs (CPU %.2fs)\n", f_i, folds[f_i].epochs, folds[f_i].trainAccuracy, folds[f_i].testAccuracy, folds[f_i].wallSeconds, folds[f_i].cpuSeconds);
+		sum += folds[f_i].testAccuracy;
+		sumSquares += folds[f_i].testAccuracy*folds[f_i].testAccuracy;
+		cpuSeconds += folds[f_i].cpuSeconds;
+	}
+	double mean = sum/foldCount;
+	double variance = foldCount > 1 ? (sumSquares - foldCount*mean*mean)/(foldCount-1) : 0.0;
+	fprintf(stdout, "Cross-validation accuracy: mean %.2f%%   variance %.4f   (std dev %.2f%%)\n", mean, variance, sqrt(variance > 0 ? variance : 0));
+	fprintf(stdout, "Time spent training folds: %.2fs (CPU %.2fs)\n", wallSeconds, cpuSeconds);
+
+	for (int f_i=0; f_i<foldCount; f_i++) {
+		cleanupNetwork(&folds[f_i].network);
+		cleanupView(&folds[f_i].trainView);
+	}
+	return 0;
+}
@@ -0,0 +1,190 @@
+/* ***********************************************************************
+ * Program: Loader.c
+ * Description: Loads the IO data file on a thread of its own, so the
+ *  first training epoch can start on the first rows while the rest of
+ *  the file is still being read.
+ * Author: agent
+ * Last Modified: 10/18/2026
+ *
+ * NOTES:
+ *  struct dataset is defined in IOData.c
+ *  The loader thread parses rows into the dataset just as getData(..)
+ *   does, and publishes each block as it is sealed: the rows loaded so
+ *   far, the bytes of the file they came from, and the number of symbols
+ *   each output column's dictionary held at that point.
+ *  Published rows, blocks and dictionary symbols never change, so the
+ *   trainer reads them without locking. The block directory is reserved
+ *   up front for the most rows the file could hold, so sealing a block
+ *   never moves it.
+ *  Which rows are training rows depends on how many rows the file holds,
+ *   which is only known once loading is done. Until then the trainer only
+ *   uses rows below a lower bound on the number of training rows: the
+ *   training partition of the rows loaded plus the rows left in the file
+ *   if every one were as long as a row can be, LOADER_ROW_BYTES(..)
+ *   (a character and a separator per column, and a '\r'). Blank lines
+ *   hold no row, so a file with many of them could break the bound; the
+ *   run then stops with an error once loading is done, rather than report
+ *   accuracies of a network which trained on test rows.
+ *  Only the fileBytes the file held when loading started are read, so
+ *   rows appended meanwhile (e.g. by the job that grows the file) can not
+ *   outgrow the reserved block directory. They are picked up next run.
+ *  The trainer grows the translation tables from the published symbols,
+ *   on its own thread, as rows appended since a checkpoint are handled
+ *   (see growTranslationMatrix(..)).
+ * ***********************************************************************
+ */
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+
+#define LOADER_ROW_BYTES(columnCount) ((columnCount)*2+1) // longest row, with a "\r\n" line ending
+
+struct loader {
+	struct dataset *data;
+	FILE *readfile;
+	double trainingPartion;
+	long fileBytes;
+	int maxRows;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t published;
+	int rowCount;
+	long bytesRead;
+	int *symbolCounts;
+	int done;
+	int failed;
+	int granted;
+} loader;
+
+/************************************** info about struct loader:
+ * readfile: the IO data file, past its column headers, read by the loader thread
+ * fileBytes: size of the IO data file
+ * maxRows: most rows the file could hold, every row is at least columnCount*2-1 bytes
+ * lock guards rowCount, bytesRead, symbolCounts, done, failed: the most recently published state
+ *  rowCount: rows loaded, bytesRead: bytes of the file they (and the column headers) came from
+ *  symbolCounts[out_i]: symbols in output column out_i's dictionary when rowCount rows were loaded
+ *  done: every row is loaded, failed: loading stopped on an error
+ * granted: most rows awaitTrainingRows(..) has said are training rows, only used by the trainer
+ */
+
+
+// publishes the rows loaded so far, done marks the last publication
+void publishRows(struct loader *loader, long bytesRead, int done, int failed) {
+	pthread_mutex_lock(&loader->lock);
+	loader->rowCount = loader->data->rowCount;
+	loader->bytesRead = bytesRead;
+	for (int out_i=0; out_i<loader->data->outputLen; out_i++)
+		loader->symbolCounts[out_i] = loader->data->dictionaries[out_i].count;
+	loader->done = done;
+	loader->failed = failed;
+	pthread_cond_broadcast(&loader->published);
+	pthread_mutex_unlock(&loader->lock);
+}
+
+void *loaderThread(void *arg) {
+	struct loader *loader = arg;
+	struct dataset *data = loader->data;
+	int bufLen = (data->inputLen+data->outputLen)*2+2;
+	char buf[bufLen];
+	long bytesRead = ftell(loader->readfile);
+	int failed = 0; // treat as boolean
+	while (!failed && bytesRead < loader->fileBytes && fgets(buf, bufLen, loader->readfile) != NULL) {
+		bytesRead += strlen(buf);
+		if (data->rowCount + data->pendingCount >= loader->maxRows) {
+			fprintf(stderr, "IO data file grew while it was loaded\n");
+			failed = 1;
+		}
+		else if (parseRow(data, buf) < 0)
+			failed = 1;
+		else if (data->pendingCount == 0)
+			publishRows(loader, bytesRead, 0, 0); // a block was just sealed
+	}
+	if (!failed && sealBlock(data) < 0)
+		failed = 1;
+	publishRows(loader, loader->fileBytes, 1, failed);
+	fclose(loader->readfile);
+	return NULL;
+}
+
+// builds data and starts loading filename into it on the loader thread
+int startLoading(struct loader *loader, struct dataset *data, char *filename, int inputLen, int outputLen, double trainingPartion) {
+	if (buildDataset(data, inputLen, outputLen) < 0)
+		return -1;
+	loader->data = data;
+	loader->trainingPartion = trainingPartion;
+	if ((loader->readfile = fopen(filename, "r")) == NULL) {
+		fprintf(stderr,"could not open file \"%s\"\n", filename);
+		return -1;
+	}
+	struct stat info;
+	if (fstat(fileno(loader->readfile), &info) < 0) {
+		fprintf(stderr,"could not read size of file \"%s\"\n", filename);
+		return -1;
+	}
+	loader->fileBytes = info.st_size;
+	loader->maxRows = (int)(loader->fileBytes / ((inputLen+outputLen)*2-1)) + 1;
+	if (reserveBlocks(data, loader->maxRows) < 0)
+		return -1;
+
+	int bufLen = (inputLen+outputLen)*2+2;
+	char buf[bufLen];
+	skipHeader(loader->readfile, buf, bufLen);
+
+	if ((loader->symbolCounts = malloc(sizeof(int)*outputLen)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to struct loader loader->symbolCounts\n");
+		return -1;
+	}
+	loader->granted = 0;
+	pthread_mutex_init(&loader->lock, NULL);
+	pthread_cond_init(&loader->published, NULL);
+	publishRows(loader, ftell(loader->readfile), 0, 0);
+	if (pthread_create(&loader->thread, NULL, loaderThread, loader) != 0) {
+		fprintf(stderr, "could not create loader thread\n");
+		return -1;
+	}
+	return 0;
+}
+
+// rows known to be training rows, exact once loading is done, loader->lock must be held
+int knownTrainingRows(struct loader *loader) {
+	if (loader->done)
+		return (int)(loader->rowCount*loader->trainingPartion);
+	long rowBytes = LOADER_ROW_BYTES(loader->data->inputLen+loader->data->outputLen);
+	int known = (int)((loader->rowCount + (loader->fileBytes - loader->bytesRead)/rowBytes)*loader->trainingPartion);
+	return known < loader->rowCount ? known : loader->rowCount;
+}
+
+/* waits until row is known to be a training row, or loading is done, and grows translations
+ * to cover every row known to be a training row
+ * returns the number of rows known to be training rows, or -1 on error, including when rows
+ *  already returned as training rows turn out to be test rows
+ */
+int awaitTrainingRows(struct loader *loader, int row, struct translation translations[]) {
+	int symbolCounts[loader->data->outputLen];
+	pthread_mutex_lock(&loader->lock);
+	while (!loader->done && knownTrainingRows(loader) <= row)
+		pthread_cond_wait(&loader->published, &loader->lock);
+	int known = loader->failed ? -1 : knownTrainingRows(loader);
+	for (int out_i=0; out_i<loader->data->outputLen; out_i++)
+		symbolCounts[out_i] = loader->symbolCounts[out_i];
+	pthread_mutex_unlock(&loader->lock);
+	if (known >= 0 && known < loader->granted) {
+		fprintf(stderr, "rows %d to %d were trained on but are test rows, IO data has too many blank lines to train while loading\n", known, loader->granted-1);
+		return -1;
+	}
+	if (known > loader->granted)
+		loader->granted = known;
+	if (known > 0 && growTranslationMatrix(loader->data, translations, symbolCounts) < 0)
+		return -1;
+	return known;
+}
+
+// waits for loading to finish, returns -1 if it failed
+int finishLoading(struct loader *loader) {
+	pthread_join(loader->thread, NULL);
+	pthread_mutex_destroy(&loader->lock);
+	pthread_cond_destroy(&loader->published);
+	free(loader->symbolCounts);
+	return loader->failed ? -1 : 0;
+}
@@ -0,0 +1,224 @@
+/* ***********************************************************************
+ * Program: Memory.c
+ * Description: Allocates large, long lived buffers (weights and dataset
+ *  blocks) on huge pages and on chosen NUMA nodes, and pins threads to
+ *  the node their memory is on.
+ * Author: agent
+ * Last Modified: 10/18/2026
+ *
+ * NOTES:
+ *  The memory policy is set once by initMemory(..), before any large
+ *   buffer is allocated:
+ *   MEMORY_OFF      large buffers are malloc'd, threads are not pinned
+ *   MEMORY_AUTO     large buffers are mmap'd and advised to use transparent
+ *                   huge pages; with more than one NUMA node, buffers are
+ *                   placed on nodes and threads are pinned to nodes
+ *   MEMORY_HUGETLB  as MEMORY_AUTO, but buffers of at least a huge page
+ *                   are first tried on explicit (hugetlbfs) huge pages
+ *  Everything falls back quietly: no reserved huge pages means transparent
+ *   huge pages, no NUMA (or a single node) means no placement or pinning,
+ *   and a failed mmap(..) means malloc(..).
+ *  Nodes are numbered 0 .. nodeCount-1 here, whatever the kernel's ids,
+ *   and any node number is taken modulo nodeCount, so thread or shard
+ *   indices can be used as node numbers to spread work across nodes.
+ *  Placement is a page at a time, so a page holding data of two nodes
+ *   (e.g. the ends of two shards) ends up on whichever was placed last.
+ *  The NUMA topology is read from /sys/devices/system/node, and pages are
+ *   placed with the mbind system call, so libnuma is not needed.
+ *  Buffers smaller than MEMORY_MMAP_MIN are always malloc'd.
+ *  _GNU_SOURCE must be defined before any system header is included, for
+ *   cpu_set_t and pthread_setaffinity_np(..).
+ *  Every buffer from allocLarge(..) has a header of MEMORY_HEADER bytes
+ *   in front of it recording how it was allocated, so freeLarge(..) needs
+ *   only the pointer. The header counts against the mapping, so a buffer
+ *   meant to fill exactly one huge page should ask for MEMORY_HUGE_PAGE -
+ *   MEMORY_HEADER bytes.
+ * ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+
+#define MEMORY_OFF 0
+#define MEMORY_AUTO 1
+#define MEMORY_HUGETLB 2
+
+#define MEMORY_MMAP_MIN (64*1024) // smaller buffers are malloc'd
+#define MEMORY_HUGE_PAGE (2*1024*1024)
+#define MEMORY_HEADER 64 // bytes in front of each buffer, keeps buffers cache line aligned
+#define MEMORY_MAX_NODES 64
+
+#define NODE_LOCAL -1 // pages go to the node of the thread which first touches them
+#define NODE_INTERLEAVE -2 // pages are spread across every node in turn
+
+// mbind(..) modes and flags, from <numaif.h> which comes with libnuma rather than libc
+#define MEMORY_MPOL_PREFERRED 1
+#define MEMORY_MPOL_INTERLEAVE 3
+#define MEMORY_MPOL_MF_MOVE (1<<1)
+
+struct memory {
+	int policy;
+	int nodeCount;
+	int nodeIds[MEMORY_MAX_NODES];
+	cpu_set_t cpus[MEMORY_MAX_NODES];
+} memory = {.policy = MEMORY_OFF, .nodeCount = 1};
+
+/************************************** info about struct memory:
+ * policy: one of MEMORY_OFF, MEMORY_AUTO, MEMORY_HUGETLB
+ * nodeCount: NUMA nodes in use, 1 if placement and pinning are off
+ * nodeIds[n]: the kernel's id of node n
+ * cpus[n]: CPUs of node n, which threads pinned to node n may run on
+ */
+
+
+/* reads a sysfs list such as "0-3,8" from path into ids, ignoring ids >= max,
+ * returns number of ids read or -1 if path could not be read
+ */
+int readIdList(char *path, int ids[], int max) {
+	FILE *readfile;
+	if ((readfile = fopen(path, "r")) == NULL)
+		return -1;
+	int count = 0, first, last;
+	while (fscanf(readfile, "%d", &first) == 1) {
+		last = first;
+		int c = fgetc(readfile);
+		if (c == '-') {
+			if (fscanf(readfile, "%d", &last) != 1)
+				break;
+			c = fgetc(readfile);
+		}
+		for (int id=first; id<=last && id<max; id++)
+			ids[count++] = id;
+		if (c != ',')
+			break;
+	}
+	fclose(readfile);
+	return count;
+}
+
+// sets the memory policy and reads the NUMA topology
+void initMemory(int policy) {
+	memory.policy = policy;
+	memory.nodeCount = 1;
+	if (policy == MEMORY_OFF)
+		return;
+
+	int count = readIdList("/sys/devices/system/node/online", memory.nodeIds, MEMORY_MAX_NODES);
+	for (int n_i=0; n_i<count; n_i++) {
+		char path[64];
+		int cpus[CPU_SETSIZE];
+		sprintf(path, "/sys/devices/system/node/node%d/cpulist", memory.nodeIds[n_i]);
+		int cpuCount = readIdList(path, cpus, CPU_SETSIZE);
+		if (cpuCount < 1)
+			return; // can not pin to this node, so treat the machine as one node
+		CPU_ZERO(&memory.cpus[n_i]);
+		for (int c_i=0; c_i<cpuCount; c_i++)
+			CPU_SET(cpus[c_i], &memory.cpus[n_i]);
+	}
+	if (count > 1) {
+		memory.nodeCount = count;
+		fprintf(stderr, "%d NUMA nodes, memory and threads are placed on nodes\n", count);
+	}
+}
+
+// sets the node pages of [addr, addr+length) are placed on, flags MEMORY_MPOL_MF_MOVE also moves pages already placed
+int bindMemory(char *addr, size_t length, int node, unsigned flags) {
+	if (memory.nodeCount < 2 || node == NODE_LOCAL)
+		return 0;
+	unsigned long mask[MEMORY_MAX_NODES/(8*sizeof(unsigned long)) + 1] = {0};
+	int bits = 8*sizeof(unsigned long);
+	for (int n_i=0; n_i<memory.nodeCount; n_i++)
+		if (node == NODE_INTERLEAVE || n_i == node % memory.nodeCount)
+			mask[memory.nodeIds[n_i]/bits] |= 1UL << (memory.nodeIds[n_i]%bits);
+	int mode = node == NODE_INTERLEAVE ? MEMORY_MPOL_INTERLEAVE : MEMORY_MPOL_PREFERRED;
+	return syscall(SYS_mbind, addr, length, mode, mask, 8*sizeof(mask), flags) == 0 ? 0 : -1;
+}
+
+/* allocates size bytes on node (or NODE_LOCAL, NODE_INTERLEAVE), on huge pages where possible,
+ * free with freeLarge(..)
+ */
+void *allocLarge(size_t size, int node) {
+	size_t length = size + MEMORY_HEADER;
+	char *block = MAP_FAILED;
+	if (memory.policy != MEMORY_OFF && size >= MEMORY_MMAP_MIN) {
+#ifdef MAP_HUGETLB
+		if (memory.policy == MEMORY_HUGETLB && length >= MEMORY_HUGE_PAGE) {
+			length = (length + MEMORY_HUGE_PAGE-1) / MEMORY_HUGE_PAGE * MEMORY_HUGE_PAGE;
+			block = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+		}
+#endif
+		if (block == MAP_FAILED) {
+			size_t pageSize = sysconf(_SC_PAGESIZE);
+			length = (size + MEMORY_HEADER + pageSize-1) / pageSize * pageSize;
+			if (length >= MEMORY_HUGE_PAGE) {
+				// transparent huge pages only back whole, aligned huge pages, so map a huge page more and trim to alignment
+				char *mapped = mmap(NULL, length + MEMORY_HUGE_PAGE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+				if (mapped != MAP_FAILED) {
+					block = (char *)(((uintptr_t)mapped + MEMORY_HUGE_PAGE-1) / MEMORY_HUGE_PAGE * MEMORY_HUGE_PAGE);
+					if (block > mapped)
+						munmap(mapped, block - mapped);
+					munmap(block + length, MEMORY_HUGE_PAGE - (block - mapped));
+#ifdef MADV_HUGEPAGE
+					madvise(block, length, MADV_HUGEPAGE);
+#endif
+				}
+			}
+			else
+				block = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		}
+		if (block != MAP_FAILED)
+			bindMemory(block, length, node, 0); // before the header is written, so no page is placed yet
+	}
+	if (block == MAP_FAILED) {
+		if ((block = malloc(size + MEMORY_HEADER)) == NULL)
+			return NULL;
+		length = 0; // malloc'd
+	}
+	*(size_t *)block = length;
+	return block + MEMORY_HEADER;
+}
+
+// moves a buffer from allocLarge(..) to node, malloc'd buffers are left where they are
+void moveLarge(void *buffer, int node) {
+	char *block = (char *)buffer - MEMORY_HEADER;
+	if (*(size_t *)block)
+		bindMemory(block, *(size_t *)block, node, MEMORY_MPOL_MF_MOVE);
+}
+
+// moves the pages holding [addr, addr+length), part of a buffer from allocLarge(..), to node
+void movePart(void *buffer, void *addr, size_t length, int node) {
+	char *block = (char *)buffer - MEMORY_HEADER;
+	if (*(size_t *)block == 0 || length == 0)
+		return; // malloc'd, its pages may hold other buffers
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	char *first = (char *)((uintptr_t)addr / pageSize * pageSize);
+	char *last = (char *)(((uintptr_t)addr + length + pageSize-1) / pageSize * pageSize);
+	bindMemory(first, last-first, node, MEMORY_MPOL_MF_MOVE);
+}
+
+void freeLarge(void *buffer) {
+	if (buffer == NULL)
+		return;
+	char *block = (char *)buffer - MEMORY_HEADER;
+	if (*(size_t *)block)
+		munmap(block, *(size_t *)block);
+	else
+		free(block);
+}
+
+// pins the calling thread to the CPUs of node index, returns the node, or -1 if threads are not pinned
+int pinThread(int index) {
+	if (memory.nodeCount < 2)
+		return -1;
+	int node = index % memory.nodeCount;
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &memory.cpus[node]) != 0)
+		return -1;
+	return node;
+}
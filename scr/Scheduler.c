@@ -0,0 +1,142 @@
+/* ***********************************************************************
+ * Program: Scheduler.c
+ * Description: Adaptive sample scheduler used by train(..) to spend
+ *  forward passes on the rows which are still being learned.
+ * Author: agent
+ * Last Modified: 10/18/2026
+ *
+ * NOTES:
+ *  struct network is defined in ANN.c
+ *  Every training row keeps a margin (how far the network's output sits
+ *   from the nearest decision boundary of the desired output, in units
+ *   of translation bins) and a streak (how many visits in a row it has
+ *   been confidently correct).
+ *  A row is confidently correct when it is correct with a margin of at
+ *   least the mean margin of correct rows in the most recent audit, so
+ *   the bar adapts as the network separates the data.
+ *  A confidently correct row is not visited again until streak epochs
+ *   have passed (capped at auditInterval). Rows near or across a
+ *   decision boundary are visited every epoch.
+ *  Every auditInterval epochs, all rows are visited regardless, so the
+ *   reported accuracy can not drift far from the truth.
+ * ***********************************************************************
+ */
+
+struct scheduler {
+	int rowCount;
+	int auditInterval;
+	double threshold;
+	double marginSum;
+	int marginCount;
+	double *margins;
+	int *streaks;
+	int *nextVisits;
+} scheduler;
+
+/************************************** info about struct scheduler:
+ * rowCount: number of training rows being scheduled
+ * auditInterval: every auditInterval epochs all rows are visited
+ * threshold: margin a correct row needs to count as confidently correct
+ * marginSum, marginCount: running total of correct rows' margins this audit
+ * margins: margin of each row from its most recent visit
+ * streaks: number of consecutive confidently correct visits of each row
+ * nextVisits: epoch at which each row is next due to be visited
+ *
+ * length of margins, streaks, nextVisits = rowCount
+ */
+
+int buildScheduler(struct scheduler *scheduler, int rowCount, int auditInterval) {
+	scheduler->rowCount = rowCount;
+	scheduler->auditInterval = auditInterval;
+	scheduler->threshold = 1.0; // nothing is confident until the first audit completes
+	scheduler->marginSum = 0.0;
+	scheduler->marginCount = 0;
+	if ((scheduler->margins = malloc(sizeof(double)*rowCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to struct scheduler scheduler->margins\n");
+		return -1;
+	}
+	if ((scheduler->streaks = malloc(sizeof(int)*rowCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to struct scheduler scheduler->streaks\n");
+		return -1;
+	}
+	if ((scheduler->nextVisits = malloc(sizeof(int)*rowCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to struct scheduler scheduler->nextVisits\n");
+		return -1;
+	}
+	// every row starts unknown, so every row is due immediately
+	for (int r_i=0; r_i<rowCount; r_i++) {
+		scheduler->margins[r_i] = 0.0;
+		scheduler->streaks[r_i] = 0;
+		scheduler->nextVisits[r_i] = 0;
+	}
+	return 0;
+}
+
+// audit epochs visit every row
+int isAuditEpoch(struct scheduler *scheduler, int epoch) {
+	return epoch % scheduler->auditInterval == 0;
+}
+
+// whether row r_i should be run forward during epoch
+int isRowDue(struct scheduler *scheduler, int r_i, int epoch) {
+	return scheduler->nextVisits[r_i] <= epoch;
+}
+
+/* margin of the most recent runForward(..) against desiredOutput
+ * for each output node, the output is scaled to translation bins (bin t_i
+ *  covers [t_i, t_i+1)), and the distance to the nearest edge of the
+ *  desired bin is measured. Outer edges of the first and last bins are
+ *  ignored since the sigmoid can never cross them.
+ * the row's margin is the smallest margin of any output node, and is
+ *  negative when the output falls outside the desired bin.
+ */
+double outputMargin(struct network *network, char *desiredOutput) {
+	double margin = 1.0;
+	for (int o_i=0; o_i<network->nodeCounts[network->layerCount-1]; o_i++) {
+		struct translation translationSet = network->translations[o_i];
+		double position = translationSet.count*network->outputs[network->layerCount-1][o_i];
+		int t_i = 0;
+		while (t_i < translationSet.count && translationSet.entries[t_i] != desiredOutput[o_i])
+			t_i++;
+		double lower = t_i > 0 ? position - t_i : 1.0;
+		double upper = t_i < translationSet.count-1 ? t_i+1 - position : 1.0;
+		if (lower < margin)
+			margin = lower;
+		if (upper < margin)
+			margin = upper;
+	}
+	return margin;
+}
+
+// records the result of visiting row r_i during epoch, and decides when it is next due
+void updateRow(struct scheduler *scheduler, int r_i, int epoch, double margin, int correct) {
+	scheduler->margins[r_i] = margin;
+	if (correct && isAuditEpoch(scheduler, epoch)) {
+		scheduler->marginSum += margin;
+		scheduler->marginCount++;
+	}
+	if (correct && margin >= scheduler->threshold) {
+		scheduler->streaks[r_i]++;
+		scheduler->nextVisits[r_i] = epoch + (scheduler->streaks[r_i] < scheduler->auditInterval ? scheduler->streaks[r_i] : scheduler->auditInterval);
+	}
+	else {
+		scheduler->streaks[r_i] = 0;
+		scheduler->nextVisits[r_i] = epoch + 1;
+	}
+}
+
+// at the end of an audit epoch, moves the confidence bar to the audit's mean correct margin
+void finishEpoch(struct scheduler *scheduler, int epoch) {
+	if (!isAuditEpoch(scheduler, epoch))
+		return;
+	if (scheduler->marginCount)
+		scheduler->threshold = scheduler->marginSum/scheduler->marginCount;
+	scheduler->marginSum = 0.0;
+	scheduler->marginCount = 0;
+}
+
+void cleanupScheduler(struct scheduler *scheduler) {
+	free(scheduler->margins);
+	free(scheduler->streaks);
+	free(scheduler->nextVisits);
+}
@@ -0,0 +1,626 @@
+/* ***********************************************************************
+ * Program: Server.c
+ * Description: Long-running scoring daemon which keeps a trained model
+ *  resident and answers rows sent over a socket or stdin.
+ * Author: agent
+ * Last Modified: 10/18/2026
+ *
+ * NOTES:
+ *  struct network is defined in ANN.c, loadCheckpoint(..) in
+ *   Checkpoint.c, listenSocket(..) and writeAll(..) in Distributed.c,
+ *   clockSeconds(..) in Autotune.c
+ *  A request is one line of comma separated input values, just like a
+ *   row of the csv file without its output values. The reply is one line
+ *   of comma separated output values, or a line starting with ERROR.
+ *   The line STATS is answered with the number of requests served, the
+ *   queue depth, and latency percentiles of recent requests. Lines longer
+ *   than SERVE_LINE_MAX are answered with ERROR.
+ *  Each connection (or stdin/stdout) has a reader thread, which queues
+ *   requests as they arrive (up to SERVE_WINDOW at a time), and a writer
+ *   thread, which writes replies in the order requests were read.
+ *  Worker threads take up to SERVE_BATCH queued requests at a time, from
+ *   any connection, and run them forward together against the same model
+ *   with runForwardBatch(..), which reads each weight once per batch.
+ *   STATS requests are answered once the rest of their batch is counted.
+ *  The model file is checked every SERVE_WATCH_MS. When it changes, the
+ *   new model is loaded and swapped in, RCU style: workers publish the
+ *   model they are using in their reader slot for the length of a batch,
+ *   and the old model is only freed once no slot holds it. Requests
+ *   already in a batch finish on the old model, later batches use the new.
+ *  Each worker has its own outputs and inputs buffers, with room for a
+ *   batch, since those are written by runForwardBatch(..); weights and
+ *   translations are shared.
+ *  On a NUMA machine workers are pinned to nodes in turn, and every model
+ *   has a replica of its weights on each node (see Memory.c), so workers
+ *   only read weights from their own node.
+ * ***********************************************************************
+ */
+
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+
+#define SERVE_BATCH 32 // requests a worker takes from the queue at once
+#define SERVE_WINDOW 64 // requests a connection may have queued at once
+#define SERVE_WATCH_MS 500 // how often the model file is checked for changes
+#define SERVE_LATENCY_SAMPLES 4096 // most recent latencies kept for percentiles
+#define SERVE_LINE_MAX 4096 // longest request line, including its line ending
+
+struct model {
+	struct network network;
+	struct network *replicas;
+	struct translation *translations;
+	int outputLen;
+	long generation;
+} model;
+
+struct connection {
+	FILE *in;
+	int outFd;
+	pthread_t reader;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	struct request *head;
+	struct request *tail;
+	int inFlight;
+	int closed;
+} connection;
+
+struct request {
+	struct connection *conn;
+	char *input;
+	int inputCount;
+	int stats;
+	char *reply;
+	double arrival;
+	int done;
+	struct request *next;
+	struct request *connNext;
+} request;
+
+struct server {
+	char *modelFile;
+	_Atomic(struct model *) current;
+	_Atomic(struct model *) *slots;
+	int workerCount;
+	pthread_mutex_t queueLock;
+	pthread_cond_t queueChanged;
+	struct request *queueHead;
+	struct request *queueTail;
+	int queueDepth;
+	int maxQueueDepth;
+	pthread_mutex_t statsLock;
+	double latencies[SERVE_LATENCY_SAMPLES];
+	long served;
+} server;
+
+/************************************** info about these structs:
+ * connection: in is read by the reader thread, outFd written by the writer
+ *  head, tail: requests in the order read, replies are written from head
+ *  inFlight: requests read but not yet replied to
+ *  closed: reader has reached end of input
+ *  lock guards head, tail, inFlight, closed and the done flag of its requests
+ * model: replicas[n] is network's copy on NUMA node n, replicas[0] is network
+ *  generation counts loads, so a model is never mistaken for an
+ *  earlier one which happened to be allocated at the same address
+ * request: input holds inputCount values, stats is set for STATS requests
+ *  reply is filled in (malloc'd) by a worker, then done is set
+ *  next links the server's queue, connNext the connection's requests
+ * server: current is the model new batches use
+ *  slots[w_i] is the model worker w_i is using, NULL between batches
+ *  queueLock guards the queue and queueDepth, maxQueueDepth
+ *  statsLock guards latencies (a ring buffer, in milliseconds) and served
+ */
+
+
+// copies m's weights to every other NUMA node, on failure m can still be freed with freeModel(..)
+int replicateModel(struct model *m) {
+	struct network *network = &m->network;
+	if ((m->replicas = calloc(memory.nodeCount, sizeof(struct network))) == NULL) {
+		fprintf(stderr, "failed to allocate memory to model replicas\n");
+		return -1;
+	}
+	if (placeNetwork(network, 0) < 0)
+		return -1;
+	m->replicas[0] = *network;
+	for (int n_i=1; n_i<memory.nodeCount; n_i++) {
+		struct network *replica = &m->replicas[n_i];
+		if (allocateNetwork(replica, network->inputLen, network->layerCount, network->nodeCounts, network->activations, network->translations) < 0)
+			return -1;
+		if (placeNetwork(replica, n_i) < 0) // before the weights are copied, so pages are placed on node n_i
+			return -1;
+		for (int l_i=0; l_i<network->layerCount; l_i++) {
+			int rowLen = l_i == 0 ? network->inputLen+1 : network->nodeCounts[l_i-1]+1;
+			memcpy(replica->weights[l_i][0], network->weights[l_i][0], sizeof(double)*rowLen*network->nodeCounts[l_i]);
+		}
+	}
+	return 0;
+}
+
+void freeModel(struct model *m) {
+	for (int n_i=1; m->replicas && n_i<memory.nodeCount; n_i++)
+		cleanupNetwork(&m->replicas[n_i]);
+	free(m->replicas);
+	cleanupNetwork(&m->network);
+	free(m->network.nodeCounts);
+	free(m->network.activations);
+	cleanupTranslations(m->translations, m->outputLen);
+	free(m->translations);
+	free(m);
+}
+
+// a checkpoint file loaded as a model
+struct model *loadModel(char *filename) {
+	static long generation = 0; // models are only loaded by one thread at a time
+	int inputLen, outputLen, rowCount, testStart, testEnd;
+	if (checkpointShape(filename, &inputLen, &outputLen) < 0)
+		return NULL;
+	struct model *m;
+	if ((m = malloc(sizeof(struct model))) == NULL) {
+		fprintf(stderr, "failed to allocate memory to model\n");
+		return NULL;
+	}
+	if ((m->translations = malloc(sizeof(struct translation)*outputLen)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to model\n");
+		free(m);
+		return NULL;
+	}
+	m->outputLen = outputLen;
+	m->generation = ++generation;
+	m->replicas = NULL;
+	if (loadCheckpoint(filename, &m->network, inputLen, outputLen, m->translations, &rowCount, &testStart, &testEnd) < 0) {
+		free(m->translations); // loadCheckpoint(..) frees everything else it allocated
+		free(m);
+		return NULL;
+	}
+	if (replicateModel(m) < 0) {
+		freeModel(m);
+		return NULL;
+	}
+	return m;
+}
+
+// model for a worker's next batch, published in the worker's slot so it is not freed meanwhile
+struct model *acquireModel(struct server *srv, int w_i) {
+	struct model *m;
+	do {
+		m = atomic_load(&srv->current);
+		atomic_store(&srv->slots[w_i], m);
+	} while (atomic_load(&srv->current) != m); // swapped before slot was published, try again
+	return m;
+}
+
+void releaseModel(struct server *srv, int w_i) {
+	atomic_store(&srv->slots[w_i], NULL);
+}
+
+// swaps in a newly loaded model, and frees the old one once no worker is using it
+void swapModel(struct server *srv, struct model *m) {
+	struct model *old = atomic_exchange(&srv->current, m);
+	for (int w_i=0; w_i<srv->workerCount; w_i++)
+		while (atomic_load(&srv->slots[w_i]) == old)
+			usleep(1000);
+	freeModel(old);
+}
+
+
+int compareDoubles(const void *a, const void *b) {
+	double d = *(const double *)a - *(const double *)b;
+	return (d > 0) - (d < 0);
+}
+
+// reply to a STATS request
+char *statsReply(struct server *srv) {
+	double sorted[SERVE_LATENCY_SAMPLES];
+	pthread_mutex_lock(&srv->statsLock);
+	long served = srv->served;
+	int count = served < SERVE_LATENCY_SAMPLES ? (int)served : SERVE_LATENCY_SAMPLES;
+	memcpy(sorted, srv->latencies, sizeof(double)*count);
+	pthread_mutex_unlock(&srv->statsLock);
+	pthread_mutex_lock(&srv->queueLock);
+	int depth = srv->queueDepth;
+	int maxDepth = srv->maxQueueDepth;
+	pthread_mutex_unlock(&srv->queueLock);
+
+	qsort(sorted, count, sizeof(double), compareDoubles);
+	char *reply;
+	if ((reply = malloc(256)) == NULL)
+		return NULL;
+	if (count == 0)
+		sprintf(reply, "served %ld   queue depth %d (max %d)\n", served, depth, maxDepth);
+	else
+		sprintf(reply, "served %ld   queue depth %d (max %d)   latency ms p50 %.3f p90 %.3f p99 %.3f max %.3f\n", served, depth, maxDepth,
+			sorted[count/2], sorted[count*9/10], sorted[count*99/100], sorted[count-1]);
+	return reply;
+}
+
+// a malloc'd copy of an ERROR reply, or NULL, which the writer answers with ERROR internal
+char *errorReply(char *message) {
+	char *reply;
+	if ((reply = malloc(strlen(message)+1)) == NULL)
+		return NULL;
+	return strcpy(reply, message);
+}
+
+/* runs a batch's requests forward on network (a worker's copy of the model's network), filling in their replies
+ * requests with the wrong number of inputs are answered with ERROR, the rest are run forward in one batch
+ */
+void scoreBatch(struct network *network, struct request **batch, int batchCount) {
+	int outputLen = network->nodeCounts[network->layerCount-1];
+	char outputs[batchCount][outputLen];
+	char *input[batchCount], *output[batchCount];
+	struct request *scored[batchCount];
+	int scoredCount = 0;
+	for (int b_i=0; b_i<batchCount; b_i++) {
+		struct request *req = batch[b_i];
+		if (req->inputCount != network->inputLen) {
+			if ((req->reply = malloc(64)) != NULL)
+				sprintf(req->reply, "ERROR expected %d inputs, got %d\n", network->inputLen, req->inputCount);
+			continue;
+		}
+		input[scoredCount] = req->input;
+		output[scoredCount] = outputs[scoredCount];
+		scored[scoredCount++] = req;
+	}
+	runForwardBatch(network, scoredCount, input, output);
+	for (int s_i=0; s_i<scoredCount; s_i++) {
+		char *reply;
+		if ((reply = malloc(outputLen*2 + 1)) == NULL)
+			continue;
+		for (int o_i=0; o_i<outputLen; o_i++) {
+			reply[o_i*2] = output[s_i][o_i];
+			reply[o_i*2+1] = o_i == outputLen-1 ? '\n' : ',';
+		}
+		reply[outputLen*2] = '\0';
+		scored[s_i]->reply = reply;
+	}
+}
+
+
+struct worker {
+	struct server *srv;
+	int index;
+} worker;
+
+void cleanupScratch(struct network *scratch) {
+	if (scratch->outputs)
+		for (int l_i=0; l_i<scratch->layerCount; l_i++)
+			free(scratch->outputs[l_i]);
+	free(scratch->outputs);
+	free(scratch->inputs);
+}
+
+// allocates scratch buffers for a copy of network, with room for a batch, so runForwardBatch(..) does not write to the model
+int allocateScratch(struct network *scratch, struct network *network) {
+	*scratch = *network;
+	scratch->inputs = malloc(sizeof(double)*scratch->inputLen*SERVE_BATCH);
+	if ((scratch->outputs = calloc(scratch->layerCount, sizeof(double *))) != NULL && scratch->inputs != NULL) {
+		int l_i = 0;
+		while (l_i < scratch->layerCount && (scratch->outputs[l_i] = malloc(sizeof(double)*scratch->nodeCounts[l_i]*SERVE_BATCH)) != NULL)
+			l_i++;
+		if (l_i == scratch->layerCount)
+			return 0;
+	}
+	fprintf(stderr, "failed to allocate memory to worker scratch\n");
+	cleanupScratch(scratch);
+	return -1;
+}
+
+void *serveWorker(void *arg) {
+	struct worker *w = arg;
+	struct server *srv = w->srv;
+	int node = pinThread(w->index);
+	long scratchGeneration = 0; // generation of the model the scratch buffers were allocated for, 0 if none are
+	struct network scratch;
+	struct request *batch[SERVE_BATCH], *scoring[SERVE_BATCH];
+	for (;;) {
+		// take up to SERVE_BATCH requests
+		pthread_mutex_lock(&srv->queueLock);
+		while (srv->queueHead == NULL)
+			pthread_cond_wait(&srv->queueChanged, &srv->queueLock);
+		int batchCount = 0;
+		while (srv->queueHead && batchCount < SERVE_BATCH) {
+			batch[batchCount++] = srv->queueHead;
+			srv->queueHead = srv->queueHead->next;
+			srv->queueDepth--;
+		}
+		if (srv->queueHead == NULL)
+			srv->queueTail = NULL;
+		pthread_mutex_unlock(&srv->queueLock);
+
+		int scoringCount = 0;
+		for (int b_i=0; b_i<batchCount; b_i++)
+			if (!batch[b_i]->stats)
+				scoring[scoringCount++] = batch[b_i];
+		if (scoringCount) {
+			struct model *m = acquireModel(srv, w->index);
+			if (m->generation != scratchGeneration) {
+				// scratch belongs to a model which may since have been freed, its shape is in scratch itself
+				if (scratchGeneration)
+					cleanupScratch(&scratch);
+				scratchGeneration = allocateScratch(&scratch, &m->replicas[node < 0 ? 0 : node]) < 0 ? 0 : m->generation;
+			}
+			if (scratchGeneration)
+				scoreBatch(&scratch, scoring, scoringCount);
+			else
+				for (int s_i=0; s_i<scoringCount; s_i++)
+					scoring[s_i]->reply = errorReply("ERROR out of memory\n");
+			releaseModel(srv, w->index);
+		}
+
+		// record latencies, then answer STATS requests, so they count the rest of their batch
+		double now = clockSeconds(CLOCK_MONOTONIC);
+		pthread_mutex_lock(&srv->statsLock);
+		for (int s_i=0; s_i<scoringCount; s_i++)
+			srv->latencies[srv->served++ % SERVE_LATENCY_SAMPLES] = 1000*(now - scoring[s_i]->arrival);
+		pthread_mutex_unlock(&srv->statsLock);
+		for (int b_i=0; b_i<batchCount; b_i++)
+			if (batch[b_i]->stats)
+				batch[b_i]->reply = statsReply(srv);
+
+		// hand replies to connections' writers
+		for (int b_i=0; b_i<batchCount; b_i++) {
+			struct connection *conn = batch[b_i]->conn;
+			pthread_mutex_lock(&conn->lock);
+			batch[b_i]->done = 1;
+			pthread_cond_broadcast(&conn->changed);
+			pthread_mutex_unlock(&conn->lock);
+		}
+	}
+	return NULL;
+}
+
+
+// parses a request line into req, returns -1 on a blank line
+int parseRequest(char *line, struct request *req) {
+	line[strcspn(line, "\r\n")] = '\0';
+	if (line[0] == '\0')
+		return -1;
+	req->stats = strcmp(line, "STATS") == 0;
+	req->inputCount = 0;
+	if ((req->input = malloc(strlen(line)+1)) == NULL)
+		return -1;
+	if (!req->stats)
+		for (char *token=line; token; token=strchr(token, ',') ? strchr(token, ',')+1 : NULL)
+			req->input[req->inputCount++] = *token;
+	return 0;
+}
+
+// whether line, read by fgets(..) into a buffer of SERVE_LINE_MAX, was cut short, in which case the rest of it is skipped
+int skipLongLine(char *line, FILE *in) {
+	int len = strlen(line);
+	if (len < SERVE_LINE_MAX-1 || line[len-1] == '\n')
+		return 0;
+	int c = fgetc(in);
+	if (c == '\n' || c == EOF)
+		return 0; // the line just fit
+	while (c != '\n' && c != EOF)
+		c = fgetc(in);
+	return 1;
+}
+
+struct connectionArgs {
+	struct server *srv;
+	struct connection *conn;
+} connectionArgs;
+
+void *connectionReader(void *arg) {
+	struct connectionArgs *args = arg;
+	struct server *srv = args->srv;
+	struct connection *conn = args->conn;
+	char line[SERVE_LINE_MAX];
+	while (fgets(line, sizeof(line), conn->in) != NULL) {
+		struct request *req;
+		if ((req = malloc(sizeof(struct request))) == NULL)
+			break;
+		// an over-long line is answered in turn, without going to a worker
+		int tooLong = skipLongLine(line, conn->in); // treat as boolean
+		if (tooLong) {
+			req->stats = 0;
+			req->input = NULL;
+		}
+		else if (parseRequest(line, req) < 0) {
+			free(req);
+			continue;
+		}
+		req->conn = conn;
+		req->reply = tooLong ? errorReply("ERROR request line too long\n") : NULL;
+		req->done = tooLong;
+		req->next = NULL;
+		req->connNext = NULL;
+		req->arrival = clockSeconds(CLOCK_MONOTONIC);
+
+		// add to connection's requests, waiting while the window is full
+		pthread_mutex_lock(&conn->lock);
+		while (conn->inFlight >= SERVE_WINDOW)
+			pthread_cond_wait(&conn->changed, &conn->lock);
+		if (conn->tail)
+			conn->tail->connNext = req;
+		else
+			conn->head = req;
+		conn->tail = req;
+		conn->inFlight++;
+		if (tooLong)
+			pthread_cond_broadcast(&conn->changed);
+		pthread_mutex_unlock(&conn->lock);
+		if (tooLong)
+			continue;
+
+		// add to server's queue
+		pthread_mutex_lock(&srv->queueLock);
+		if (srv->queueTail)
+			srv->queueTail->next = req;
+		else
+			srv->queueHead = req;
+		srv->queueTail = req;
+		if (++srv->queueDepth > srv->maxQueueDepth)
+			srv->maxQueueDepth = srv->queueDepth;
+		pthread_cond_signal(&srv->queueChanged);
+		pthread_mutex_unlock(&srv->queueLock);
+	}
+	pthread_mutex_lock(&conn->lock);
+	conn->closed = 1;
+	pthread_cond_broadcast(&conn->changed);
+	pthread_mutex_unlock(&conn->lock);
+	return NULL;
+}
+
+// writes replies in request order until the reader is done, then frees the connection
+void *connectionWriter(void *arg) {
+	struct connectionArgs *args = arg;
+	struct connection *conn = args->conn;
+	for (;;) {
+		pthread_mutex_lock(&conn->lock);
+		while (!(conn->head && conn->head->done) && !(conn->closed && conn->head == NULL))
+			pthread_cond_wait(&conn->changed, &conn->lock);
+		struct request *req = conn->head;
+		if (req == NULL) {
+			pthread_mutex_unlock(&conn->lock);
+			break;
+		}
+		conn->head = req->connNext;
+		if (conn->head == NULL)
+			conn->tail = NULL;
+		conn->inFlight--;
+		pthread_cond_broadcast(&conn->changed);
+		pthread_mutex_unlock(&conn->lock);
+
+		char *reply = req->reply ? req->reply : "ERROR internal\n";
+		writeAll(conn->outFd, (unsigned char *)reply, strlen(reply)); // a closed peer still drains its requests
+		free(req->reply);
+		free(req->input);
+		free(req);
+	}
+	pthread_join(conn->reader, NULL);
+	fclose(conn->in);
+	close(conn->outFd);
+	free(conn);
+	free(args);
+	return NULL;
+}
+
+// starts reader and writer threads for a connection, returns the writer
+int startConnection(struct server *srv, int inFd, int outFd, pthread_t *writer) {
+	struct connection *conn;
+	struct connectionArgs *args;
+	if ((conn = malloc(sizeof(struct connection))) == NULL || (args = malloc(sizeof(struct connectionArgs))) == NULL) {
+		fprintf(stderr, "failed to allocate memory to connection\n");
+		return -1;
+	}
+	if ((conn->in = fdopen(inFd, "r")) == NULL) {
+		fprintf(stderr, "could not read from connection\n");
+		return -1;
+	}
+	conn->outFd = outFd;
+	pthread_mutex_init(&conn->lock, NULL);
+	pthread_cond_init(&conn->changed, NULL);
+	conn->head = NULL;
+	conn->tail = NULL;
+	conn->inFlight = 0;
+	conn->closed = 0;
+	args->srv = srv;
+	args->conn = conn;
+	if (pthread_create(&conn->reader, NULL, connectionReader, args) != 0 || pthread_create(writer, NULL, connectionWriter, args) != 0) {
+		fprintf(stderr, "could not create connection threads\n");
+		return -1;
+	}
+	return 0;
+}
+
+
+// reloads the model whenever its file changes
+void *modelWatcher(void *arg) {
+	struct server *srv = arg;
+	struct stat last, now;
+	if (stat(srv->modelFile, &last) < 0)
+		memset(&last, 0, sizeof(last));
+	for (;;) {
+		usleep(SERVE_WATCH_MS*1000);
+		if (stat(srv->modelFile, &now) < 0)
+			continue;
+		if (now.st_ino == last.st_ino && now.st_size == last.st_size && now.st_mtim.tv_sec == last.st_mtim.tv_sec && now.st_mtim.tv_nsec == last.st_mtim.tv_nsec)
+			continue;
+		last = now;
+		struct model *m;
+		if ((m = loadModel(srv->modelFile)) == NULL) {
+			fprintf(stderr, "could not reload model \"%s\", still serving previous model\n", srv->modelFile);
+			continue;
+		}
+		swapModel(srv, m);
+		fprintf(stderr, "reloaded model \"%s\"\n", srv->modelFile);
+	}
+	return NULL;
+}
+
+/* serves the model in modelFile on address ("-" for stdin/stdout) with workerCount worker threads
+ * on stdin, returns once every line has been answered, otherwise serves until killed
+ */
+int serve(char *modelFile, char *address, int workerCount) {
+	static struct server srv; // too large for the stack, and lives as long as the program
+	srv.modelFile = modelFile;
+	srv.workerCount = workerCount;
+	pthread_mutex_init(&srv.queueLock, NULL);
+	pthread_cond_init(&srv.queueChanged, NULL);
+	pthread_mutex_init(&srv.statsLock, NULL);
+	srv.queueHead = NULL;
+	srv.queueTail = NULL;
+	srv.queueDepth = 0;
+	srv.maxQueueDepth = 0;
+	srv.served = 0;
+
+	struct model *m;
+	if ((m = loadModel(modelFile)) == NULL)
+		return -1;
+	atomic_init(&srv.current, m);
+	if ((srv.slots = malloc(sizeof(*srv.slots)*workerCount)) == NULL) {
+		fprintf(stderr, "failed to allocate memory to server slots\n");
+		return -1;
+	}
+	for (int w_i=0; w_i<workerCount; w_i++)
+		atomic_init(&srv.slots[w_i], NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	struct worker workers[workerCount];
+	pthread_t threads[workerCount], watcher;
+	for (int w_i=0; w_i<workerCount; w_i++) {
+		workers[w_i].srv = &srv;
+		workers[w_i].index = w_i;
+		if (pthread_create(&threads[w_i], NULL, serveWorker, &workers[w_i]) != 0) {
+			fprintf(stderr, "could not create worker thread %d\n", w_i);
+			return -1;
+		}
+	}
+	if (pthread_create(&watcher, NULL, modelWatcher, &srv) != 0) {
+		fprintf(stderr, "could not create model watcher thread\n");
+		return -1;
+	}
+	fprintf(stderr, "serving model \"%s\" (%d inputs, %d outputs) on %s with %d workers\n", modelFile, m->network.inputLen, m->outputLen, strcmp(address, "-") ? address : "stdin", workerCount);
+
+	if (strcmp(address, "-") == 0) {
+		pthread_t writer;
+		if (startConnection(&srv, STDIN_FILENO, STDOUT_FILENO, &writer) < 0)
+			return -1;
+		pthread_join(writer, NULL);
+		return 0;
+	}
+
+	int listenFd;
+	if ((listenFd = listenSocket(address, SOMAXCONN)) < 0)
+		return -1;
+	for (;;) {
+		int fd;
+		if ((fd = accept(listenFd, NULL, NULL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "could not accept connection\n");
+			return -1;
+		}
+		int inFd;
+		pthread_t writer;
+		if ((inFd = dup(fd)) < 0 || startConnection(&srv, inFd, fd, &writer) < 0) {
+			close(fd);
+			continue;
+		}
+		pthread_detach(writer);
+	}
+}
@@ -20,7 +20,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <unistd.h>
+
+
+#define ROLE_LOCAL -2 // run parameter server and workers in this process and its children
+#define ROLE_SERVER -1 // run only the parameter server, workers are roles 0 .. workerCount-1
 
 
 struct paramaters {
@@ -30,6 +36,7 @@ struct paramaters {
 	int outputLen;
 	int layerCount;
 	int *nodeCounts;
+	int *activations;
 	double learningRate;
 	int maxEpoch;
 	double trainingPartion;
@@ -37,14 +44,28 @@ struct paramaters {
 	int PrePost;
 	int precision;
 	int converganceRange;
+	int auditInterval;
+	char *checkpoint;
+	double replayRatio;
+	int workerCount;
+	int role;
+	char *address;
+	int staleness;
+	double autotuneBudget;
+	double accuracyFloor;
+	int folds;
+	int threadCount;
+	char *serveAddress;
+	int memoryPolicy;
 } paramaters;
 
 
 char *getFileName(int argc, char** argv);
 int getOutputCount(int argc, char** argv);
-int getInputInfo(char *filename, int *IOCount, int *inputLen);
+int getInputInfo(char *filename, int *inputLen);
 int getLayerCount(int argc, char** argv, int inputLen);
 int getNodeCounts(int argc, char **argv, int layerCount, int nodeCounts[], int inputLen, int outputLen);
+int getActivations(int argc, char **argv, int layerCount, int activations[]);
 double getLearningRate(int argc, char** argv);
 int getMaxEpoch(int argc, char** argv);
 double getTrainingPartion(int argc, char** argv);
@@ -52,6 +73,19 @@ char *getDumpWeights(int argc, char** argv);
 int getPrePostWeights(int argc, char** argv);
 int getPrecision(int argc, char** argv);
 int getconverganceRange(int argc, char** argv);
+int getAuditInterval(int argc, char** argv);
+char *getCheckpoint(int argc, char** argv);
+double getReplayRatio(int argc, char** argv);
+int getWorkerCount(int argc, char** argv);
+int getRole(int argc, char** argv, int workerCount);
+char *getAddress(int argc, char** argv, int role);
+int getStaleness(int argc, char** argv);
+double getAutotuneBudget(int argc, char** argv);
+double getAccuracyFloor(int argc, char** argv);
+int getFolds(int argc, char** argv);
+int getThreadCount(int argc, char** argv);
+char *getServeAddress(int argc, char** argv);
+int getMemoryPolicy(int argc, char** argv);
 
 int findFlagArg(int argc, char** argv, char c);
 void avgBetween(int arr[], int s, int e);
@@ -61,15 +95,31 @@ void printParams(struct paramaters params);
 
 
 int parseArgs(int argc, char** argv, struct paramaters *params) {
+	// serving a model needs only the model's checkpoint and threads, not an IO data file
+	if ((params->serveAddress = getServeAddress(argc, argv)) != NULL) {
+		params->filename = NULL;
+		params->nodeCounts = NULL;
+		params->activations = NULL;
+		if ((params->checkpoint = getCheckpoint(argc, argv)) == NULL) {
+			fprintf(stderr, "flag -s requires a model checkpoint via flag -w\n");
+			return -1;
+		}
+		if ((params->threadCount = getThreadCount(argc, argv)) < 0)
+			return -1;
+		if ((params->memoryPolicy = getMemoryPolicy(argc, argv)) < 0)
+			return -1;
+		return 0;
+	}
+	
 	// set paramaters, use args if supplied
 	if ((params->filename  = getFileName(argc, argv)) == argv[0])
 		return -1;
 	
 	if ((params->outputLen = getOutputCount(argc, argv)) < 0)
 		return -1;
-	params->IOCount = 0;
+	params->IOCount = 0; // rows are counted as they are loaded, see getData(..) and Loader.c
 	params->inputLen = 1-params->outputLen;
-	if (getInputInfo(params->filename, &(params->IOCount), &(params->inputLen)) < 0)
+	if (getInputInfo(params->filename, &(params->inputLen)) < 0)
 		return -1;
 	
 	if ((params->layerCount = getLayerCount(argc, argv, params->inputLen)) < 0)
@@ -82,6 +132,13 @@ int parseArgs(int argc, char** argv, struct paramaters *params) {
 	if (getNodeCounts(argc, argv, params->layerCount, params->nodeCounts, params->inputLen, params->outputLen) < 0)
 		return -1;
 	
+	if ((params->activations = malloc(params->layerCount*sizeof(int))) == NULL) {
+		fprintf(stderr, "failed to allocate memory to struct paramaters params->activations\n");
+		return -1;
+	}
+	if (getActivations(argc, argv, params->layerCount, params->activations) < 0)
+		return -1;
+	
 	if ((params->learningRate = getLearningRate(argc, argv)) < 0)
 		return -1;
 	
@@ -102,6 +159,41 @@ int parseArgs(int argc, char** argv, struct paramaters *params) {
 	if ((params->converganceRange = getconverganceRange(argc, argv)) < 0)
 		return -1;
 	
+	if ((params->auditInterval = getAuditInterval(argc, argv)) < 0)
+		return -1;
+	
+	params->checkpoint = getCheckpoint(argc, argv);
+	
+	if ((params->replayRatio = getReplayRatio(argc, argv)) < 0)
+		return -1;
+	
+	if ((params->workerCount = getWorkerCount(argc, argv)) < 0)
+		return -1;
+	
+	if ((params->role = getRole(argc, argv, params->workerCount)) < ROLE_LOCAL)
+		return -1;
+	
+	if ((params->address = getAddress(argc, argv, params->role)) == argv[0])
+		return -1;
+	
+	if ((params->staleness = getStaleness(argc, argv)) < 0)
+		return -1;
+	
+	if ((params->autotuneBudget = getAutotuneBudget(argc, argv)) < 0)
+		return -1;
+	
+	if ((params->accuracyFloor = getAccuracyFloor(argc, argv)) < 0)
+		return -1;
+	
+	if ((params->folds = getFolds(argc, argv)) < 0)
+		return -1;
+	
+	if ((params->threadCount = getThreadCount(argc, argv)) < 0)
+		return -1;
+	
+	if ((params->memoryPolicy = getMemoryPolicy(argc, argv)) < 0)
+		return -1;
+	
 	return 0;
 }
 
@@ -134,8 +226,8 @@ int getOutputCount(int argc, char** argv) {
 		return 1; // default length of output vector
 }
 
-// reads input file to determine inputLen, inputLen, and number of entries
-int getInputInfo(char *filename, int *IOCount, int *inputLen) {
+// reads column titles of input file to determine inputLen, rows are counted as they are loaded
+int getInputInfo(char *filename, int *inputLen) {
 	FILE *readfile;
 	if ((readfile = fopen(filename, "r")) == NULL) {
 		fprintf(stderr,"could not open file \"%s\"\n", filename);
@@ -150,10 +242,6 @@ int getInputInfo(char *filename, int *IOCount, int *inputLen) {
 		fprintf(stderr,"requested outputLen must allow for inputLen of at least 1\n");
 		return -1;
 	}
-	// count lines after titles
-	while ((c = fgetc(readfile)) != EOF)
-		if (c == '\n')
-			(*IOCount)++;
 	fclose(readfile);
 	return 0; // no problems
 }
@@ -210,6 +298,44 @@ int getNodeCounts(int argc, char **argv, int layerCount, int nodeCounts[], int i
 	return 0; // no problems
 }
 
+/* user may choose the activation function of the hidden layers, either one name for every hidden layer
+ * or one name per hidden layer in order of layer, the output layer is always sigmoid
+ */
+int getActivations(int argc, char **argv, int layerCount, int activations[]) {
+	for (int l_i=0; l_i<layerCount; l_i++)
+		activations[l_i] = ACTIVATION_SIGMOID; // default
+	int arg_i;
+	if ((arg_i = findFlagArg(argc, argv, 'a')+1) < argc) {
+		// have -a flag, take names until one is not an activation
+		if (layerCount == 1) {
+			fprintf(stderr, "flag -a should not be used without hidden layers, the output layer is always sigmoid\n");
+			return -1; // error
+		}
+		int count = 0;
+		while (arg_i < argc && count < layerCount-1) {
+			int a_i = 0;
+			while (a_i < ACTIVATION_COUNT && strcmp(argv[arg_i], activationNames[a_i]) != 0)
+				a_i++;
+			if (a_i == ACTIVATION_COUNT)
+				break;
+			activations[count++] = a_i;
+			arg_i++;
+		}
+		if (count == 0) {
+			fprintf(stderr, "flag -a must be followed by hidden layer activations: sigmoid, tanh, relu, or leaky\n");
+			return -1; // error
+		}
+		if (count == 1)
+			for (int l_i=1; l_i<layerCount-1; l_i++)
+				activations[l_i] = activations[0];
+		else if (count != layerCount-1) {
+			fprintf(stderr, "number of activations must be 1 or match number of hidden layers\n");
+			return -1; // error
+		}
+	}
+	return 0; // no problems
+}
+
 // get value for learningRate
 double getLearningRate(int argc, char** argv) {
 	int index;
@@ -308,6 +434,203 @@ int getconverganceRange(int argc, char** argv) {
 		return 32 ; // default range
 }
 
+// gets number of epochs between full passes when mining hard examples (0 disables mining)
+int getAuditInterval(int argc, char** argv) {
+	int index;
+	int interval;
+	if ((index = findFlagArg(argc, argv, 'm')+1) < argc) {
+		if ((interval = atoi(argv[index])) > 1)
+			return interval;
+		else {
+			fprintf(stderr, "audit interval must be greater than 1\n");
+			return -1; // error, entered value <= 1
+		}
+	}
+	else
+		return 0 ; // default, visit every row every epoch
+}
+
+// requests program to resume from and save to the specified checkpoint file
+char *getCheckpoint(int argc, char** argv) {
+	int index;
+	if ((index = findFlagArg(argc, argv, 'w')+1) < argc)
+		return argv[index]; // return address of name of checkpoint file
+	return NULL;
+}
+
+// get ratio of previously trained rows which are replayed when resuming from a checkpoint
+double getReplayRatio(int argc, char** argv) {
+	int index;
+	double ratio;
+	if ((index = findFlagArg(argc, argv, 'y')+1) < argc) {
+		if (((ratio = atof(argv[index])) >= 0) && (ratio <= 1))
+			return ratio;
+		else {
+			fprintf(stderr, "replay ratio must be between 0 and 1 (inclusive)\n");
+			return -1; // error, entered value < 0 or > 1
+		}
+	}
+	else
+		return 0.0 ; // default, replay no old rows
+}
+
+// gets number of worker processes for distributed training (0 trains in this process alone)
+int getWorkerCount(int argc, char** argv) {
+	int index;
+	int workerCount;
+	if ((index = findFlagArg(argc, argv, 'x')+1) < argc) {
+		if ((workerCount = atoi(argv[index])) > 0)
+			return workerCount;
+		else {
+			fprintf(stderr, "number of workers must be greater than 0\n");
+			return -1; // error, entered value < 1
+		}
+	}
+	else
+		return 0 ; // default, no distributed training
+}
+
+// gets this process's part in distributed training, "server" or a worker index
+int getRole(int argc, char** argv, int workerCount) {
+	int index;
+	int role;
+	if ((index = findFlagArg(argc, argv, 'g')+1) < argc) {
+		if (workerCount == 0) {
+			fprintf(stderr, "flag -g should not be used without specifying workerCount via flag -x\n");
+			return -3; // error
+		}
+		if (strcmp(argv[index], "server") == 0)
+			return ROLE_SERVER;
+		if (((role = atoi(argv[index])) >= 0) && (role < workerCount) && (argv[index][0] >= '0') && (argv[index][0] <= '9'))
+			return role;
+		fprintf(stderr, "role must be \"server\" or a worker index between 0 and workerCount-1\n");
+		return -3; // error
+	}
+	else
+		return ROLE_LOCAL ; // default, fork workers locally
+}
+
+// gets address of parameter server, "host:port" for TCP or a Unix domain socket path
+char *getAddress(int argc, char** argv, int role) {
+	int index;
+	if ((index = findFlagArg(argc, argv, 'i')+1) < argc)
+		return argv[index]; // return address of parameter server address
+	if (role != ROLE_LOCAL) {
+		fprintf(stderr, "flag -g requires the parameter server address via flag -i\n");
+		return argv[0]; // error
+	}
+	return NULL; // default, a socket in /tmp is chosen when training
+}
+
+// gets how many rounds workers may run ahead of the slowest worker
+int getStaleness(int argc, char** argv) {
+	int index;
+	int staleness;
+	if ((index = findFlagArg(argc, argv, 'z')+1) < argc) {
+		if ((staleness = atoi(argv[index])) >= 0)
+			return staleness;
+		else {
+			fprintf(stderr, "staleness must be at least 0\n");
+			return -1; // error, entered value < 0
+		}
+	}
+	else
+		return 0 ; // default, synchronous averaging
+}
+
+// gets number of seconds to spend autotuning the topology (0 does not autotune)
+double getAutotuneBudget(int argc, char** argv) {
+	int index;
+	double budget;
+	if ((index = findFlagArg(argc, argv, 'u')+1) < argc) {
+		if ((budget = atof(argv[index])) > 0)
+			return budget;
+		else {
+			fprintf(stderr, "autotune time budget must be greater than 0\n");
+			return -1; // error, entered value <= 0
+		}
+	}
+	else
+		return 0.0 ; // default, no autotuning
+}
+
+// gets % validation accuracy a topology must reach to be recommended by autotuning
+double getAccuracyFloor(int argc, char** argv) {
+	int index;
+	double accuracyFloor;
+	if ((index = findFlagArg(argc, argv, 'f')+1) < argc) {
+		if (((accuracyFloor = atof(argv[index])) >= 0) && (accuracyFloor <= 100))
+			return accuracyFloor;
+		else {
+			fprintf(stderr, "accuracy floor must be between 0 and 100 (inclusive)\n");
+			return -1; // error, entered value < 0 or > 100
+		}
+	}
+	else
+		return 90.0 ; // default accuracy floor
+}
+
+// gets number of folds for k-fold cross-validation (0 does not cross-validate)
+int getFolds(int argc, char** argv) {
+	int index;
+	int folds;
+	if ((index = findFlagArg(argc, argv, 'k')+1) < argc) {
+		if ((folds = atoi(argv[index])) > 1)
+			return folds;
+		else {
+			fprintf(stderr, "number of folds must be greater than 1\n");
+			return -1; // error, entered value <= 1
+		}
+	}
+	else
+		return 0 ; // default, no cross-validation
+}
+
+// gets number of threads to train with where work can run in parallel
+int getThreadCount(int argc, char** argv) {
+	int index;
+	int threadCount;
+	if ((index = findFlagArg(argc, argv, 'j')+1) < argc) {
+		if ((threadCount = atoi(argv[index])) > 0)
+			return threadCount;
+		else {
+			fprintf(stderr, "number of threads must be greater than 0\n");
+			return -1; // error, entered value < 1
+		}
+	}
+	else {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		return cpus > 0 ? (int)cpus : 1; // default, one thread per CPU
+	}
+}
+
+// requests program to serve a model on the specified address ("-" for stdin) rather than train
+char *getServeAddress(int argc, char** argv) {
+	int index;
+	if ((index = findFlagArg(argc, argv, 's')+1) < argc)
+		return argv[index]; // return address to serve on
+	return NULL;
+}
+
+// chooses how large buffers are allocated and threads placed, see Memory.c
+int getMemoryPolicy(int argc, char** argv) {
+	int index;
+	if ((index = findFlagArg(argc, argv, 'M')+1) < argc) {
+		if (strcmp(argv[index], "auto") == 0)
+			return MEMORY_AUTO;
+		else if (strcmp(argv[index], "off") == 0)
+			return MEMORY_OFF;
+		else if (strcmp(argv[index], "hugetlb") == 0)
+			return MEMORY_HUGETLB;
+		else {
+			fprintf(stderr, "memory policy must be auto, off, or hugetlb\n");
+			return -1; // error, unknown policy
+		}
+	}
+	else
+		return MEMORY_AUTO; // default, transparent huge pages and NUMA placement where available
+}
+
 
 // finds the index of argument containing flag c
 int findFlagArg(int argc, char** argv, char c) {
@@ -333,10 +656,23 @@ void printParams(struct paramaters params) {
 	fprintf(stdout, "maxEpoch: %d   convergancePrecision: %d   converganceRange: %d\n", params.maxEpoch, (int)(log(params.precision)/log(10)), params.converganceRange);
 	if (params.dumpFile)
 		fprintf(stdout, "dumpFileName: %s\n", params.dumpFile);
+	if (params.checkpoint)
+		fprintf(stdout, "checkpoint: %s   replayRatio: %f\n", params.checkpoint, params.replayRatio);
+	if (params.autotuneBudget)
+		fprintf(stdout, "autotune budget: %.1fs   accuracyFloor: %.2f%%\n", params.autotuneBudget, params.accuracyFloor);
+	if (params.folds)
+		fprintf(stdout, "cross-validation folds: %d   threads: %d\n", params.folds, params.threadCount);
+	if (params.workerCount)
+		fprintf(stdout, "distributed workers: %d   staleness: %d\n", params.workerCount, params.staleness);
+	if (params.auditInterval)
+		fprintf(stdout, "hard example mining, auditInterval: %d\n", params.auditInterval);
+	if (params.memoryPolicy != MEMORY_AUTO)
+		fprintf(stdout, "memory policy: %s\n", params.memoryPolicy == MEMORY_OFF ? "off" : "hugetlb");
 }
 
 void cleanupParams(struct paramaters *params) {
 	free(params->nodeCounts);
+	free(params->activations);
 }
 
 
@@ -13,16 +13,30 @@
  *   but underneath that, functions generally do what they are named after.
  *  In reading the code for this program, I recommend viewing files as
  *   their functions are called. i.e.
+ *    Memory.c
  *    parseArgs.c
  *    IOData.c
  *    ANNManager.c
  *    ANN.c
+ *    Checkpoint.c
+ *    Distributed.c
+ *    Autotune.c
+ *    KFold.c
+ *    Server.c
+ *    Loader.c
  * ***********************************************************************
  */
 
 
-#include "parseArgs.c"
+#define _GNU_SOURCE // for thread pinning in Memory.c
+#include "Memory.c"
 #include "ANNManager.c"
+#include "parseArgs.c"
+#include "Checkpoint.c"
+#include "Distributed.c"
+#include "Autotune.c"
+#include "KFold.c"
+#include "Server.c"
 
 
 int main(int argc, char** argv) {
@@ -30,24 +44,127 @@ int main(int argc, char** argv) {
 	struct paramaters params;
 	if (parseArgs(argc, argv, &params) < 0)
 		return 0; // error, quit program
+	initMemory(params.memoryPolicy);
+	
+	// scoring daemon mode, see Server.c
+	if (params.serveAddress) {
+		serve(params.checkpoint, params.serveAddress, params.threadCount);
+		cleanupParams(&params);
+		return 0;
+	}
 	printParams(params);
 	
-	// build IO array
-	struct IOData io[params.IOCount];
-	if (getData(io, params.filename, params.IOCount, params.inputLen, params.outputLen) < 0)
-		return 0; // error, quit program
+	int resumed = params.checkpoint && checkpointExists(params.checkpoint); // treat as boolean
+	// training a new network locally overlaps loading the dataset with the first epoch, see Loader.c
+	int pipelined = !params.autotuneBudget && !params.folds && !params.workerCount && !resumed; // treat as boolean
+	
+	// build dataset
+	struct dataset data;
+	struct loader loader;
+	if (pipelined) {
+		if (startLoading(&loader, &data, params.filename, params.inputLen, params.outputLen, params.trainingPartion) < 0)
+			return 0; // error, quit program
+	}
+	else {
+		if (getData(&data, params.filename, params.inputLen, params.outputLen) < 0)
+			return 0; // error, quit program
+		params.IOCount = data.rowCount;
+		fprintf(stdout, "Dataset: %d rows packed into %zu bytes\n", data.rowCount, datasetBytes(&data));
+	}
 	// TODO shuffle IO data ?
 	
-	// build translation matrix (translates ANN output to character output)
 	struct translation translations[params.outputLen];
-	if (buildTranslationMatrix(params.IOCount, params.outputLen, io, translations) < 0)
+	struct network network;
+	int trainingIOCount = (int)(params.IOCount*params.trainingPartion); // while loading, found once loading is done
+	
+	// autotune mode only recommends a topology, it does not go on to train
+	if (params.autotuneBudget) {
+		if (buildTranslationMatrix(&data, translations) < 0)
+			return 0;
+		fprintf(stdout, "\nAutotuning ANN...\n");
+		if (autotune(&data, viewRange(&data, 0, trainingIOCount), translations, params.layerCount > 1 ? params.activations[0] : ACTIVATION_SIGMOID, params.autotuneBudget, params.accuracyFloor, params.maxEpoch, params.learningRate) < 0)
+			return 0;
+		cleanupTranslations(translations, params.outputLen);
+		cleanupDataset(&data);
+		cleanupParams(&params);
 		return 0;
+	}
 	
-  fprintf(stdout, "\nBuilding ANN...\n");
-	// build ANN
-	struct network network;
-	if (buildNetwork(&network, params.inputLen, params.layerCount, params.nodeCounts, translations) < 0)
+	// cross-validation mode reports on every fold, it does not go on to train a single network
+	if (params.folds) {
+		if (buildTranslationMatrix(&data, translations) < 0)
+			return 0;
+		fprintf(stdout, "\nCross-validating ANN...\n");
+		if (crossValidate(&data, params.folds, params.threadCount, params.layerCount, params.nodeCounts, params.activations, translations, params.maxEpoch, params.learningRate, params.precision, params.converganceRange) < 0)
+			return 0;
+		cleanupTranslations(translations, params.outputLen);
+		cleanupDataset(&data);
+		cleanupParams(&params);
 		return 0;
+	}
+	
+	int rowCount = 0; // number of leading rows of data the network has seen
+	int testStart = trainingIOCount, testEnd = params.IOCount; // rows held out for testing
+	int replayAll = 0; // treat as boolean
+	if (resumed) {
+		// resume ANN and translation matrix from checkpoint
+		fprintf(stdout, "\nResuming ANN from checkpoint \"%s\"...\n", params.checkpoint);
+		if (loadCheckpoint(params.checkpoint, &network, params.inputLen, params.outputLen, translations, &rowCount, &testStart, &testEnd) < 0)
+			return 0;
+		printTopology(network);
+		// topology comes from the checkpoint rather than from args
+		free(params.nodeCounts);
+		free(params.activations);
+		params.nodeCounts = network.nodeCounts;
+		params.activations = network.activations;
+		params.layerCount = network.layerCount;
+		if (rowCount > data.rowCount) {
+			fprintf(stderr, "checkpoint has seen %d rows, IO data has only %d\n", rowCount, data.rowCount);
+			return 0;
+		}
+		srand(time(NULL)); // before reset output nodes are randomized
+		// output characters which have appeared since the checkpoint was saved
+		int added, oldCounts[params.outputLen];
+		for (int o_i=0; o_i<params.outputLen; o_i++)
+			oldCounts[o_i] = translations[o_i].count;
+		if ((added = growTranslationMatrix(&data, translations, NULL)) < 0)
+			return 0;
+		if (added) {
+			// new characters move every output value range of their node, so those nodes start over on every row
+			replayAll = 1;
+			fprintf(stdout, "Added %d new output characters to translations, reset %d output nodes and replaying every trained row\n", added, resetOutputNodes(&network, oldCounts));
+		}
+		fprintf(stdout, "Checkpoint has seen %d rows, testing on rows %d to %d\n", rowCount, testStart, testEnd);
+	}
+	else {
+		// build translation matrix (translates ANN output to character output)
+		// while loading, it starts empty and grows as output characters are loaded
+		if (pipelined)
+			for (int o_i=0; o_i<params.outputLen; o_i++) {
+				translations[o_i].count = 0;
+				translations[o_i].entries = NULL;
+			}
+		else if (buildTranslationMatrix(&data, translations) < 0)
+			return 0;
+		
+		fprintf(stdout, "\nBuilding ANN...\n");
+		// build ANN
+		if (buildNetwork(&network, params.inputLen, params.layerCount, params.nodeCounts, params.activations, translations) < 0)
+			return 0;
+	}
+	
+	// when resuming, train only on rows appended since the checkpoint (plus replayed old rows)
+	struct datasetView trainView = viewRange(&data, 0, trainingIOCount);
+	if (resumed) {
+		// rows the checkpoint has not seen are all training rows
+		// the replayed rows and their order only depend on the checkpoint and the IO data, so every
+		// separately started worker (-g) shards the same view
+		srand((unsigned)rowCount*31 + (unsigned)data.rowCount);
+		if (rowCount >= data.rowCount && !replayAll)
+			trainView.count = 0;
+		else if (buildResumeView(&data, rowCount, data.rowCount, testStart, testEnd, replayAll ? 1.0 : params.replayRatio, &trainView) < 0)
+			return 0;
+	}
 	
 	// "Pre" of the "Pre/Post" training weight printout
 	if (params.PrePost) {
@@ -60,10 +177,65 @@ int main(int argc, char** argv) {
 	// CPU timing
 	clock_t start, end;
 	start = clock();
-	if (train(network, io, (int)(params.IOCount*params.trainingPartion), params.maxEpoch, params.learningRate, params.dumpFile, params.precision, params.converganceRange) < 0)
+	if (trainView.count == 0 && !pipelined)
+		fprintf(stdout, "No new rows to train on\n");
+	else if (params.workerCount) {
+		// distributed training, see Distributed.c
+		char localAddress[64];
+		if (params.address == NULL) {
+			sprintf(localAddress, "/tmp/ann-%d.sock", (int)getpid());
+			params.address = localAddress;
+		}
+		if (params.role == ROLE_LOCAL) {
+			if (trainDistributed(&network, trainView, params.address, params.workerCount, params.maxEpoch, params.learningRate, params.precision, params.converganceRange, params.staleness) < 0)
+				return 0;
+		}
+		else if (params.role == ROLE_SERVER) {
+			int listenFd;
+			signal(SIGPIPE, SIG_IGN);
+			if ((listenFd = listenSocket(params.address, params.workerCount)) < 0)
+				return 0;
+			if (runParameterServer(&network, listenFd, params.workerCount, params.maxEpoch, params.precision, params.converganceRange, params.staleness) < 0)
+				return 0;
+			close(listenFd);
+		}
+		else {
+			// a worker's part ends once the server stops training
+			struct datasetView shard;
+			signal(SIGPIPE, SIG_IGN);
+			if (buildShardView(trainView, params.workerCount, params.role, &shard) < 0)
+				return 0;
+			placeView(shard, params.role);
+			if (runWorker(&network, shard, params.address, params.role, params.learningRate) < 0)
+				return 0;
+			cleanupView(&shard);
+			cleanupView(&trainView);
+			cleanupNetwork(&network);
+			cleanupTranslations(translations, params.outputLen);
+			cleanupDataset(&data);
+			cleanupParams(&params);
+			return 0;
+		}
+	}
+	else if (train(network, trainView, pipelined ? &loader : NULL, params.maxEpoch, params.learningRate, params.dumpFile, params.precision, params.converganceRange, params.auditInterval) < 0)
 		return 0;
 	end = clock();
 	double elapsedTime = ((double) (end - start)) / CLOCKS_PER_SEC;
+	cleanupView(&trainView);
+	if (pipelined) {
+		if (finishLoading(&loader) < 0)
+			return 0;
+		params.IOCount = data.rowCount;
+		trainingIOCount = (int)(params.IOCount*params.trainingPartion);
+		testStart = trainingIOCount;
+		testEnd = params.IOCount;
+		fprintf(stdout, "Dataset: %d rows packed into %zu bytes\n", data.rowCount, datasetBytes(&data));
+	}
+	struct datasetView testView = viewRange(&data, testStart, testEnd-testStart);
+	
+	// save checkpoint to resume from when rows are appended to the IO data file
+	if (params.checkpoint && saveCheckpoint(params.checkpoint, &network, data.rowCount, testStart, testEnd) < 0)
+		return 0;
 	
 	// "Post" of the "Pre/Post" training weight printout
 	if (params.PrePost) {
@@ -73,14 +245,14 @@ int main(int argc, char** argv) {
 	
   fprintf(stdout, "\nTesting ANN...\n");
 	// test ANN
-	if (trial(network, io+(int)(params.IOCount*params.trainingPartion), params.IOCount-(int)(params.IOCount*params.trainingPartion)) < 0)
+	if (trial(network, testView) < 0)
 		return 0;
 	fprintf(stdout, "CPU time spent training: %.2fs\n", elapsedTime);
 	
 	// free allocated memory
 	cleanupNetwork(&network);
 	cleanupTranslations(translations, params.outputLen);
-	cleanupIO(io, params.IOCount);
+	cleanupDataset(&data);
 	cleanupParams(&params);
 	return 0;
 }